@@ -16,9 +16,80 @@
 
 using namespace libzerocoin;
 
-std::map<uint32_t, CBigNum> mapAccumulatorValues;
+CAccumulatorValueCache accumulatorValueCache;
 std::list<uint256> listAccCheckpointsNoDB;
 
+CAccumulatorValueCache::CAccumulatorValueCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn), nHits(0), nMisses(0), nEvictions(0)
+{
+}
+
+void CAccumulatorValueCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (listValues.size() > nMaxEntries) {
+        mapValues.erase(listValues.back().first);
+        listValues.pop_back();
+        nEvictions++;
+    }
+}
+
+bool CAccumulatorValueCache::Get(uint32_t nChecksum, CBigNum& bnValue)
+{
+    LOCK(cs);
+    auto it = mapValues.find(nChecksum);
+    if (it == mapValues.end()) {
+        nMisses++;
+        return false;
+    }
+    listValues.splice(listValues.begin(), listValues, it->second);
+    bnValue = it->second->second;
+    nHits++;
+    return true;
+}
+
+void CAccumulatorValueCache::Insert(uint32_t nChecksum, const CBigNum& bnValue)
+{
+    LOCK(cs);
+    auto it = mapValues.find(nChecksum);
+    if (it != mapValues.end()) {
+        it->second->second = bnValue;
+        listValues.splice(listValues.begin(), listValues, it->second);
+        return;
+    }
+    listValues.push_front(std::make_pair(nChecksum, bnValue));
+    mapValues[nChecksum] = listValues.begin();
+    Trim();
+}
+
+void CAccumulatorValueCache::Erase(uint32_t nChecksum)
+{
+    LOCK(cs);
+    auto it = mapValues.find(nChecksum);
+    if (it == mapValues.end())
+        return;
+    listValues.erase(it->second);
+    mapValues.erase(it);
+}
+
+void CAccumulatorValueCache::SetMaxEntries(size_t nMaxEntriesIn)
+{
+    LOCK(cs);
+    nMaxEntries = nMaxEntriesIn;
+    Trim();
+}
+
+CAccumulatorCacheStats CAccumulatorValueCache::GetStats() const
+{
+    LOCK(cs);
+    CAccumulatorCacheStats stats;
+    stats.nEntries = listValues.size();
+    stats.nMaxEntries = nMaxEntries;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEvictions = nEvictions;
+    return stats;
+}
+
 uint32_t ParseChecksum(uint256 nChecksum, CoinDenomination denomination)
 {
     //shift to the beginning bit of this denomination and trim any remaining bits by returning 32 bits only
@@ -62,17 +133,25 @@ int GetChecksumHeight(uint32_t nChecksum, CoinDenomination denomination)
     return 0;
 }
 
-bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue)
+//! Cached value of nChecksum, read from the database and cached on a miss. False if it is in neither.
+bool ReadAccumulatorValue(uint32_t nChecksum, CBigNum& bnAccValue)
 {
-    if (mapAccumulatorValues.count(nChecksum)) {
-        bnAccValue = mapAccumulatorValues.at(nChecksum);
+    if (accumulatorValueCache.Get(nChecksum, bnAccValue))
         return true;
-    }
 
-    if (fMemoryOnly)
+    if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccValue))
         return false;
 
-    if (!zerocoinDB->ReadAccumulatorValue(nChecksum, bnAccValue)) {
+    accumulatorValueCache.Insert(nChecksum, bnAccValue);
+    return true;
+}
+
+bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue)
+{
+    if (fMemoryOnly)
+        return accumulatorValueCache.Get(nChecksum, bnAccValue);
+
+    if (!ReadAccumulatorValue(nChecksum, bnAccValue)) {
         bnAccValue = 0;
     }
 
@@ -90,7 +169,7 @@ void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue)
     //Since accumulators are switching at v2, stop databasing v1 because its useless. Only focus on v2.
     if (chainActive.Height() >= Params().Zerocoin_Block_V2_Start()) {
         zerocoinDB->WriteAccumulatorValue(nChecksum, bnValue);
-        mapAccumulatorValues.insert(make_pair(nChecksum, bnValue));
+        accumulatorValueCache.Insert(nChecksum, bnValue);
     }
 }
 
@@ -108,7 +187,7 @@ void DatabaseChecksums(AccumulatorMap& mapAccumulators)
 bool EraseChecksum(uint32_t nChecksum)
 {
     //erase from both memory and database
-    mapAccumulatorValues.erase(nChecksum);
+    accumulatorValueCache.Erase(nChecksum);
     return zerocoinDB->EraseAccumulatorValue(nChecksum);
 }
 
@@ -142,11 +221,42 @@ bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint)
             LogPrint("zero", "%s : Missing databased value for checksum %d", __func__, nChecksum);
             return false;
         }
-        mapAccumulatorValues.insert(make_pair(nChecksum, bnValue));
+        accumulatorValueCache.Insert(nChecksum, bnValue);
     }
     return true;
 }
 
+//Same bookkeeping of missing checkpoints as LoadAccumulatorValuesFromDB, without decoding the values
+bool HaveAccumulatorValuesInDB(const uint256 nCheckpoint)
+{
+    for (auto& denomination : zerocoinDenomList) {
+        uint32_t nChecksum = ParseChecksum(nCheckpoint, denomination);
+        if (!zerocoinDB->HaveAccumulatorValue(nChecksum)) {
+            if (!count(listAccCheckpointsNoDB.begin(), listAccCheckpointsNoDB.end(), nCheckpoint))
+                listAccCheckpointsNoDB.push_back(nCheckpoint);
+            LogPrint("zero", "%s : Missing databased value for checksum %d", __func__, nChecksum);
+            return false;
+        }
+    }
+    return true;
+}
+
+//Load the values of the last nCheckpoints distinct checkpoints up to pindexTip, the newest ending up most recently used
+void WarmAccumulatorValueCache(const CBlockIndex* pindexTip, int nCheckpoints)
+{
+    std::vector<uint256> vCheckpoints;
+    for (const CBlockIndex* pindex = pindexTip; pindex && pindex->nHeight >= Params().Zerocoin_Block_V2_Start() && (int)vCheckpoints.size() < nCheckpoints; pindex = pindex->pprev) {
+        if (pindex->nAccumulatorCheckpoint == 0)
+            continue;
+        if (vCheckpoints.empty() || vCheckpoints.back() != pindex->nAccumulatorCheckpoint)
+            vCheckpoints.push_back(pindex->nAccumulatorCheckpoint);
+    }
+
+    for (auto it = vCheckpoints.rbegin(); it != vCheckpoints.rend(); ++it)
+        LoadAccumulatorValuesFromDB(*it);
+    LogPrint("zero", "%s : loaded %u checkpoints, %u values cached\n", __func__, vCheckpoints.size(), accumulatorValueCache.GetStats().nEntries);
+}
+
 //Erase accumulator checkpoints for a certain block range
 bool EraseCheckpoints(int nStartHeight, int nEndHeight)
 {
@@ -351,7 +461,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
     int n = 0;
     while (pindex->nHeight < nHeightEnd) {
-        n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+        n += pindex->GetMintCount(denom);
         pindex = chainActive.Next(pindex);
     }
 
@@ -543,8 +653,7 @@ map<CoinDenomination, int> GetMintMaturityHeight()
         for (auto denom : libzerocoin::zerocoinDenomList) {
             //If the denom has not already had a mint added to it, then see if it has a mint added on this block
             if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-                mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-                                                          pindex->vMintDenominationsInBlock.end(), denom);
+                mapDenomMaturity.at(denom).first += pindex->GetMintCount(denom);
 
                 //if mint was found then record this block as the first block that maturity occurs.
                 if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
@@ -13,18 +13,72 @@
 #include "primitives/zerocoin.h"
 #include "accumulatormap.h"
 #include "chain.h"
+#include "sync.h"
 #include "uint256.h"
 
+#include <list>
+#include <map>
+
 class CBlockIndex;
 
+//! -accvaluecache default, number of accumulator values kept in memory
+static const unsigned int DEFAULT_ACCUMULATOR_VALUE_CACHE = 800;
+//! checkpoints loaded into the accumulator value cache at startup
+static const int ACCUMULATOR_CACHE_WARM_CHECKPOINTS = 20;
+
+struct CAccumulatorCacheStats {
+    size_t nEntries;
+    size_t nMaxEntries;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+
+    CAccumulatorCacheStats() : nEntries(0), nMaxEntries(0), nHits(0), nMisses(0), nEvictions(0) {}
+};
+
+/**
+ * Decoded accumulator values by checksum, least recently used evicted first.
+ * Spends reference the same few recent checkpoints over and over, so this
+ * saves both the zerocoin DB read and the bignum decode.
+ */
+class CAccumulatorValueCache
+{
+private:
+    mutable CCriticalSection cs;
+    size_t nMaxEntries;
+    //! most recently used first
+    std::list<std::pair<uint32_t, CBigNum> > listValues;
+    std::map<uint32_t, std::list<std::pair<uint32_t, CBigNum> >::iterator> mapValues;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+
+    void Trim();
+
+public:
+    explicit CAccumulatorValueCache(size_t nMaxEntriesIn = DEFAULT_ACCUMULATOR_VALUE_CACHE);
+
+    //! Memory only lookup, marks the entry as most recently used
+    bool Get(uint32_t nChecksum, CBigNum& bnValue);
+    void Insert(uint32_t nChecksum, const CBigNum& bnValue);
+    void Erase(uint32_t nChecksum);
+    void SetMaxEntries(size_t nMaxEntriesIn);
+    CAccumulatorCacheStats GetStats() const;
+};
+
+extern CAccumulatorValueCache accumulatorValueCache;
+
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
 bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
+bool ReadAccumulatorValue(uint32_t nChecksum, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, AccumulatorMap& mapAccumulators);
 void DatabaseChecksums(AccumulatorMap& mapAccumulators);
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint);
+bool HaveAccumulatorValuesInDB(const uint256 nCheckpoint);
+void WarmAccumulatorValueCache(const CBlockIndex* pindexTip, int nCheckpoints);
 bool EraseAccumulatorValues(const uint256& nCheckpointErase, const uint256& nCheckpointPrevious);
 uint32_t ParseChecksum(uint256 nChecksum, libzerocoin::CoinDenomination denomination);
 uint32_t GetChecksum(const CBigNum &bnValue);
@@ -77,14 +77,17 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+CNetAddrHasher::CNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())),
+                                   k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    boost::unordered_map<CNetAddr, int, CNetAddrHasher>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    boost::unordered_map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return NULL;
@@ -93,13 +96,14 @@ CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
     int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    CAddrInfo& info = mapInfo[nId];
+    info = CAddrInfo(addr, addrSource);
     mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    info.nRandomPos = vRandom.size();
     vRandom.push_back(nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &info;
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -112,27 +116,65 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
+    boost::unordered_map<int, CAddrInfo>::iterator it1 = mapInfo.find(nId1);
+    boost::unordered_map<int, CAddrInfo>::iterator it2 = mapInfo.find(nId2);
+    assert(it1 != mapInfo.end());
+    assert(it2 != mapInfo.end());
 
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    it1->second.nRandomPos = nRndPos2;
+    it2->second.nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
 }
 
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    int& nSlotIndex = vvTriedSlotIndex[nKBucket][nKBucketPos];
+    if (nId != -1 && nSlotIndex == -1) {
+        nSlotIndex = vTriedSlots.size();
+        vTriedSlots.push_back(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos);
+    } else if (nId == -1 && nSlotIndex != -1) {
+        // move the last slot into the hole
+        int nSlotLast = vTriedSlots.back();
+        vTriedSlots[nSlotIndex] = nSlotLast;
+        vvTriedSlotIndex[nSlotLast / ADDRMAN_BUCKET_SIZE][nSlotLast % ADDRMAN_BUCKET_SIZE] = nSlotIndex;
+        vTriedSlots.pop_back();
+        nSlotIndex = -1;
+    }
+    vvTried[nKBucket][nKBucketPos] = nId;
+}
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    int& nSlotIndex = vvNewSlotIndex[nUBucket][nUBucketPos];
+    if (nId != -1 && nSlotIndex == -1) {
+        nSlotIndex = vNewSlots.size();
+        vNewSlots.push_back(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos);
+        vNewBucketSize[nUBucket]++;
+    } else if (nId == -1 && nSlotIndex != -1) {
+        int nSlotLast = vNewSlots.back();
+        vNewSlots[nSlotIndex] = nSlotLast;
+        vvNewSlotIndex[nSlotLast / ADDRMAN_BUCKET_SIZE][nSlotLast % ADDRMAN_BUCKET_SIZE] = nSlotIndex;
+        vNewSlots.pop_back();
+        nSlotIndex = -1;
+        vNewBucketSize[nUBucket]--;
+    }
+    vvNew[nUBucket][nUBucketPos] = nId;
+}
+
 void CAddrMan::Delete(int nId)
 {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo& info = mapInfo[nId];
+    boost::unordered_map<int, CAddrInfo>::iterator it = mapInfo.find(nId);
+    assert(it != mapInfo.end());
+    CAddrInfo& info = it->second;
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
     mapAddr.erase(info);
-    mapInfo.erase(nId);
+    mapInfo.erase(it);
     nNew--;
 }
 
@@ -144,7 +186,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -153,11 +195,11 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
 
 void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 {
-    // remove the entry from all new buckets
-    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+    // remove the entry from all new buckets, stopping once all its references are found
+    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT && info.nRefCount > 0; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -178,7 +220,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -189,12 +231,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -225,21 +267,11 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = GetRandInt(ADDRMAN_NEW_BUCKET_COUNT);
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
-        int nB = (n + nRnd) % ADDRMAN_NEW_BUCKET_COUNT;
-        int nBpos = info.GetBucketPosition(nKey, true, nB);
-        if (vvNew[nB][nBpos] == nId) {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // every reference of an entry outside the tried table is a position in a new bucket,
+    // so there is no need to hash the entry into each bucket to find one.
+    // if it has none, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1)
+    if (info.nRefCount == 0)
         return;
 
     LogPrint("addrman", "Moving %s to tried\n", addr.ToString());
@@ -306,7 +338,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -340,34 +372,36 @@ CAddress CAddrMan::Select_()
     if (size() == 0)
         return CAddress();
 
+    int64_t nNow = GetAdjustedTime();
+
     // Use a 50% chance for choosing between tried and new table entries.
+    // Positions are drawn from the occupied ones only, which picks each entry with the
+    // same odds as probing random positions of the mostly empty tables until one is hit.
     if (nTried > 0 && (nNew == 0 || GetRandInt(2) == 0)) {
         // use a tried node
+        assert(!vTriedSlots.empty());
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = GetRandInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = GetRandInt(ADDRMAN_BUCKET_SIZE);
-            if (vvTried[nKBucket][nKBucketPos] == -1)
-                continue;
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
+            int nSlot = vTriedSlots[GetRandInt(vTriedSlots.size())];
+            int nId = vvTried[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
+            boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            const CAddrInfo& info = it->second;
+            if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance(nNow) * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
         }
     } else {
         // use a new node
+        assert(!vNewSlots.empty());
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = GetRandInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = GetRandInt(ADDRMAN_BUCKET_SIZE);
-            if (vvNew[nUBucket][nUBucketPos] == -1)
-                continue;
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
+            int nSlot = vNewSlots[GetRandInt(vNewSlots.size())];
+            int nId = vvNew[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
+            boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            const CAddrInfo& info = it->second;
+            if (GetRandInt(1 << 30) < fChanceFactor * info.GetChance(nNow) * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
         }
@@ -383,7 +417,7 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    for (boost::unordered_map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
         int n = (*it).first;
         CAddrInfo& info = (*it).second;
         if (info.fInTried) {
@@ -414,32 +448,57 @@ int CAddrMan::Check_()
     if (mapNew.size() != nNew)
         return -10;
 
-    for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
+    // Only the occupied positions are hashed, the slot lists must therefore match the tables exactly
+    int nNewOccupied = 0;
+    for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
+        int nBucketSize = 0;
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-            if (vvTried[n][i] != -1) {
-                if (!setTried.count(vvTried[n][i]))
-                    return -11;
-                if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
-                    return -17;
-                if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
-                    return -18;
-                setTried.erase(vvTried[n][i]);
-            }
+            if ((vvNew[n][i] == -1) != (vvNewSlotIndex[n][i] == -1))
+                return -20;
+            if (vvNew[n][i] != -1)
+                nBucketSize++;
         }
+        if (nBucketSize != vNewBucketSize[n])
+            return -21;
+        nNewOccupied += nBucketSize;
     }
-
-    for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
+    if (nNewOccupied != (int)vNewSlots.size())
+        return -22;
+    for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-            if (vvNew[n][i] != -1) {
-                if (!mapNew.count(vvNew[n][i]))
-                    return -12;
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
-                    return -19;
-                if (--mapNew[vvNew[n][i]] == 0)
-                    mapNew.erase(vvNew[n][i]);
-            }
+            if ((vvTried[n][i] == -1) != (vvTriedSlotIndex[n][i] == -1))
+                return -20;
         }
     }
+    if ((int)vTriedSlots.size() != nTried)
+        return -22;
+
+    for (unsigned int nIndex = 0; nIndex < vTriedSlots.size(); nIndex++) {
+        int n = vTriedSlots[nIndex] / ADDRMAN_BUCKET_SIZE;
+        int i = vTriedSlots[nIndex] % ADDRMAN_BUCKET_SIZE;
+        if (vvTriedSlotIndex[n][i] != (int)nIndex)
+            return -23;
+        if (!setTried.count(vvTried[n][i]))
+            return -11;
+        if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
+            return -17;
+        if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
+            return -18;
+        setTried.erase(vvTried[n][i]);
+    }
+
+    for (unsigned int nIndex = 0; nIndex < vNewSlots.size(); nIndex++) {
+        int n = vNewSlots[nIndex] / ADDRMAN_BUCKET_SIZE;
+        int i = vNewSlots[nIndex] % ADDRMAN_BUCKET_SIZE;
+        if (vvNewSlotIndex[n][i] != (int)nIndex)
+            return -23;
+        if (!mapNew.count(vvNew[n][i]))
+            return -12;
+        if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
+            return -19;
+        if (--mapNew[vvNew[n][i]] == 0)
+            mapNew.erase(vvNew[n][i]);
+    }
 
     if (setTried.size())
         return -13;
@@ -458,17 +517,21 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
     if (nNodes > ADDRMAN_GETADDR_MAX)
         nNodes = ADDRMAN_GETADDR_MAX;
 
-    // gather a list of random nodes, skipping those of low quality
+    // gather a list of random nodes, skipping those of low quality; only the
+    // front of vRandom that is actually handed out gets shuffled
+    int64_t nNow = GetAdjustedTime();
+    vAddr.reserve(vAddr.size() + nNodes);
     for (unsigned int n = 0; n < vRandom.size(); n++) {
         if (vAddr.size() >= nNodes)
             break;
 
         int nRndPos = GetRandInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.find(vRandom[n]);
+        assert(it != mapInfo.end());
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
-        if (!ai.IsTerrible())
+        const CAddrInfo& ai = it->second;
+        if (!ai.IsTerrible(nNow))
             vAddr.push_back(ai);
     }
 }
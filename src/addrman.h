@@ -21,6 +21,8 @@
 #include <stdint.h>
 #include <vector>
 
+#include <boost/unordered_map.hpp>
+
 /** 
  * Extended statistics about a CAddress 
  */
@@ -128,6 +130,8 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *    * The occupied positions of both tables are kept in dense lists, so selecting a random entry does not probe
+ *      the mostly empty tables, and serializing the "new" buckets does not scan them.
  */
 
 //! total number of buckets for tried addresses
@@ -166,6 +170,21 @@ public:
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+/** Salted hash of the IP of an address, for the address index of CAddrMan */
+class CNetAddrHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const
+    {
+        return addr.GetSaltedHash(k0, k1);
+    }
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -182,10 +201,10 @@ private:
     int nIdCount;
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    boost::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    boost::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -202,6 +221,21 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position) of vvTried, in no particular order
+    std::vector<int> vTriedSlots;
+
+    //! index of each position of vvTried in vTriedSlots, -1 if it is empty
+    int vvTriedSlotIndex[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
+
+    //! occupied positions of vvNew, in no particular order
+    std::vector<int> vNewSlots;
+
+    //! index of each position of vvNew in vNewSlots, -1 if it is empty
+    int vvNewSlotIndex[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
+
+    //! number of occupied positions in each "new" bucket
+    int vNewBucketSize[ADDRMAN_NEW_BUCKET_COUNT];
+
 protected:
     //! Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int* pnId = NULL);
@@ -213,6 +247,12 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    //! Store nId (or -1 to empty it) at a position of the "tried" table, keeping vTriedSlots up to date.
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+
+    //! Store nId (or -1 to empty it) at a position of the "new" table, keeping vNewSlots up to date.
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+
     //! Move an entry from the "new" table(s) to the "tried" table
     void MakeTried(CAddrInfo& info, int nId);
 
@@ -290,19 +330,20 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        boost::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.rehash(nNew);
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            mapUnkIds[(*it).first] = nIds;
+        for (boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             const CAddrInfo& info = (*it).second;
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
+                mapUnkIds[(*it).first] = nIds;
                 s << info;
                 nIds++;
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             const CAddrInfo& info = (*it).second;
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
@@ -311,16 +352,13 @@ public:
             }
         }
         for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            int nSize = 0;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1)
-                    nSize++;
-            }
+            int nSize = vNewBucketSize[bucket];
             s << nSize;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+            for (int i = 0; nSize > 0 && i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
                     int nIndex = mapUnkIds[vvNew[bucket][i]];
                     s << nIndex;
+                    nSize--;
                 }
             }
         }
@@ -346,6 +384,13 @@ public:
         if (nVersion != 0) {
             nUBuckets ^= (1 << 30);
         }
+        if (nNew < 0 || nTried < 0)
+            throw std::ios_base::failure("Negative table size in addrman deserialization");
+        // entries beyond what the tables can hold are dropped below, do not reserve room for them
+        int nReserve = std::min(nNew, ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) + std::min(nTried, ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE);
+        mapInfo.rehash(nReserve);
+        mapAddr.rehash(nReserve);
+        vRandom.reserve(nReserve);
 
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
@@ -360,7 +405,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -380,7 +425,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -400,7 +445,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -408,9 +453,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end();) {
+        for (boost::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end();) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                boost::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -432,15 +477,22 @@ public:
     void Clear()
     {
         std::vector<int>().swap(vRandom);
+        std::vector<int>().swap(vNewSlots);
+        std::vector<int>().swap(vTriedSlots);
+        mapInfo.clear();
+        mapAddr.clear();
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvNew[bucket][entry] = -1;
+                vvNewSlotIndex[bucket][entry] = -1;
             }
+            vNewBucketSize[bucket] = 0;
         }
         for (size_t bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvTried[bucket][entry] = -1;
+                vvTriedSlotIndex[bucket][entry] = -1;
             }
         }
 
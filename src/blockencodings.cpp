@@ -0,0 +1,172 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <map>
+
+//! Smallest possible serialized transaction, bounds the transaction count of a block
+static const unsigned int MIN_TRANSACTION_SIZE = 60;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                             header(block.GetBlockHeader()),
+                                                                             vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // The coinbase and the coinstake never were in anyone's mempool
+    size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    nPrefilled = std::min(nPrefilled, block.vtx.size());
+    for (size_t i = 0; i < nPrefilled; i++) {
+        PrefilledTransaction prefilled;
+        prefilled.index = 0; // differentially encoded, each directly follows the previous one
+        prefilled.tx = block.vtx[i];
+        prefilledtxn.push_back(prefilled);
+    }
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++)
+        shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hash);
+    shorttxidk0 = ReadLE64(hash);
+    shorttxidk1 = ReadLE64(hash + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffULL;
+}
+
+CBlock CBlockHeaderAndShortTxIDs::GetHeaderBlock() const
+{
+    CBlock block(header);
+    block.vchBlockSig = vchBlockSig;
+    for (size_t i = 0; i < prefilledtxn.size() && prefilledtxn[i].index == 0; i++)
+        block.vtx.push_back(prefilledtxn[i].tx);
+    return block;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE_CURRENT / MIN_TRANSACTION_SIZE || cmpctblock.BlockTxCount() > std::numeric_limits<uint16_t>::max())
+        return READ_STATUS_INVALID;
+
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    txn_available.assign(cmpctblock.BlockTxCount(), CTransaction());
+    vHave.assign(cmpctblock.BlockTxCount(), false);
+
+    int32_t nLastPrefilled = -1;
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        if (cmpctblock.prefilledtxn[i].tx.IsNull())
+            return READ_STATUS_INVALID;
+
+        // the index is the distance to the previous prefilled one, check for overflow before adding
+        nLastPrefilled += cmpctblock.prefilledtxn[i].index + 1;
+        if (nLastPrefilled > std::numeric_limits<uint16_t>::max())
+            return READ_STATUS_INVALID;
+        if ((uint32_t)nLastPrefilled > cmpctblock.shorttxids.size() + i)
+            return READ_STATUS_INVALID;
+        txn_available[nLastPrefilled] = cmpctblock.prefilledtxn[i].tx;
+        vHave[nLastPrefilled] = true;
+    }
+
+    // Map every short id to the block index it stands for
+    std::map<uint64_t, uint16_t> mapShortIds;
+    uint16_t nIndexOffset = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
+        while (vHave[i + nIndexOffset])
+            nIndexOffset++;
+        if (!mapShortIds.insert(std::make_pair(cmpctblock.shorttxids[i], i + nIndexOffset)).second) {
+            // Two transactions of the block share a short id; rare enough to just fetch the block
+            return READ_STATUS_FAILED;
+        }
+    }
+
+    // A short id matching two mempool transactions is requested instead of guessed
+    std::vector<bool> vCollided(txn_available.size(), false);
+    size_t nMempoolCount = 0;
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+            std::map<uint64_t, uint16_t>::const_iterator idit = mapShortIds.find(cmpctblock.GetShortID(it->first));
+            if (idit == mapShortIds.end() || vCollided[idit->second])
+                continue;
+            if (vHave[idit->second]) {
+                txn_available[idit->second] = CTransaction();
+                vHave[idit->second] = false;
+                vCollided[idit->second] = true;
+                nMempoolCount--;
+                continue;
+            }
+            // shares the zerocoin data the mempool copy already parsed
+            txn_available[idit->second] = it->second.GetTx();
+            vHave[idit->second] = true;
+            nMempoolCount++;
+        }
+    }
+
+    LogPrint("net", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu, %u of %u transactions from the mempool\n",
+        cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION), nMempoolCount, cmpctblock.shorttxids.size());
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < vHave.size());
+    return vHave[index];
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing)
+{
+    assert(!header.IsNull());
+    block = CBlock(header);
+    block.vtx.resize(txn_available.size());
+    block.vchBlockSig = vchBlockSig;
+
+    size_t nMissing = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (vHave[i]) {
+            block.vtx[i] = txn_available[i];
+        } else {
+            if (nMissing >= vtx_missing.size())
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtx_missing[nMissing++];
+        }
+    }
+    if (nMissing != vtx_missing.size())
+        return READ_STATUS_INVALID;
+
+    // Free the memory of this attempt, the block is either complete or fetched in full
+    header.SetNull();
+    txn_available.clear();
+    vHave.clear();
+
+    // A short id collision with a mempool transaction shows up as a wrong merkle root,
+    // which says nothing about the block itself
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("net", "Successfully reconstructed block %s with %u transactions sent in blocktxn\n", block.GetHash().ToString(), vtx_missing.size());
+    return READ_STATUS_OK;
+}
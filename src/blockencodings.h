@@ -0,0 +1,204 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+
+#include <ios>
+#include <vector>
+
+class CTxMemPool;
+
+//! Version of the compact block encoding announced in "sendcmpct"
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+//! -compactblocks default
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+//! Only blocks this close to the tip are sent as "cmpctblock", older ones in full
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+//! Only transactions of blocks this close to the tip are served through "getblocktxn"
+static const int MAX_BLOCKTXN_DEPTH = 10;
+//! Seconds to wait for the "blocktxn" of a compact block before the block is fetched in full
+static const int BLOCKTXN_TIMEOUT = 10;
+//! Number of peers asked to push new blocks to us as "cmpctblock" without an "inv" first
+static const unsigned int MAX_HB_COMPACT_PEERS = 3;
+
+/**
+ * Transactions of a block a peer wants after failing to rebuild the block
+ * from its compact form ("getblocktxn"). The indexes are sent as varint
+ * differences to the previous index.
+ */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        uint64_t nCount = indexes.size();
+        READWRITE(VARINT(nCount));
+        if (ser_action.ForRead()) {
+            if (nCount > std::numeric_limits<uint16_t>::max())
+                throw std::ios_base::failure("indexes overflowed 16 bits");
+            indexes.resize(nCount);
+        }
+
+        uint32_t nNext = 0;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            uint32_t nDiff = ser_action.ForRead() ? 0 : indexes[i] - nNext;
+            READWRITE(VARINT(nDiff));
+            if (ser_action.ForRead()) {
+                if ((uint64_t)nNext + nDiff > std::numeric_limits<uint16_t>::max())
+                    throw std::ios_base::failure("indexes overflowed 16 bits");
+                indexes[i] = nNext + nDiff;
+            }
+            nNext = indexes[i] + 1;
+        }
+    }
+};
+
+/** Answer to a "getblocktxn": the requested transactions, in the order asked for ("blocktxn") */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent along in full inside a compact block, at index (differentially encoded) */
+struct PrefilledTransaction {
+    uint16_t index;
+    CTransaction tx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        uint32_t nIndex = index;
+        READWRITE(VARINT(nIndex));
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("index overflowed 16 bits");
+        index = nIndex;
+        READWRITE(tx);
+    }
+};
+
+/** Result of rebuilding a block from its compact form */
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //!< the peer sent something malformed
+    READ_STATUS_FAILED,  //!< could not rebuild the block, fetch it in full
+};
+
+/**
+ * A block announced as header, 6 byte short ids of the transactions the
+ * receiver most likely has in its mempool, and in full the ones it can not
+ * have: the coinbase and, for proof of stake blocks, the coinstake, which
+ * carries the (large) zerocoin spend of a zPoS block. Short ids are SipHash
+ * of the txid keyed by SHA256(header || nonce), so they differ per block and
+ * sender and collisions can not be precomputed ("cmpctblock").
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    //! The header, the prefilled transactions the block starts with and the block signature:
+    //! enough to check the proof of stake before the rest of the block is rebuilt
+    CBlock GetHeaderBlock() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        uint64_t nShortIds = shorttxids.size();
+        READWRITE(VARINT(nShortIds));
+        if (ser_action.ForRead()) {
+            if (nShortIds > MAX_BLOCK_SIZE_CURRENT)
+                throw std::ios_base::failure("too many short ids");
+            shorttxids.resize(nShortIds);
+        }
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            uint32_t lsb = shorttxids[i] & 0xffffffff;
+            uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+            READWRITE(lsb);
+            READWRITE(msb);
+            shorttxids[i] = ((uint64_t)msb << 32) | lsb;
+        }
+
+        READWRITE(prefilledtxn);
+        READWRITE(vchBlockSig);
+
+        if (ser_action.ForRead())
+            FillShortTxIDSelector();
+    }
+};
+
+/** A block being rebuilt from a compact block, the mempool and a "blocktxn" answer */
+class PartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> txn_available;
+    std::vector<bool> vHave;
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+public:
+    //! Fill in what the compact block and the mempool provide
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, CTxMemPool& pool);
+    bool IsTxAvailable(size_t index) const;
+    size_t GetTxCount() const { return txn_available.size(); }
+    uint256 GetBlockHash() const { return header.GetHash(); }
+    //! Complete the block with the missing transactions, in index order
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing);
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
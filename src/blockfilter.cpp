@@ -0,0 +1,277 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+
+/** Appends bits most significant first to a byte vector */
+class BitStreamWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    unsigned char nBuffer;
+    int nBits; //!< bits used in nBuffer
+
+public:
+    BitStreamWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nBits(0) {}
+
+    void Write(uint64_t nValue, int nCount)
+    {
+        while (nCount > 0) {
+            int nTake = std::min(8 - nBits, nCount);
+            unsigned char bits = (nValue >> (nCount - nTake)) & ((1 << nTake) - 1);
+            nBuffer |= bits << (8 - nBits - nTake);
+            nBits += nTake;
+            nCount -= nTake;
+            if (nBits == 8)
+                Flush();
+        }
+    }
+
+    //! Write out a partly filled last byte, padded with zeros
+    void Flush()
+    {
+        if (nBits == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nBits = 0;
+    }
+};
+
+/** Reads bits most significant first from a byte range */
+class BitStreamReader
+{
+private:
+    const unsigned char* pch;
+    const unsigned char* pend;
+    int nOffset; //!< bits of *pch already read
+
+public:
+    BitStreamReader(const unsigned char* pchIn, const unsigned char* pendIn) : pch(pchIn), pend(pendIn), nOffset(0) {}
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t nValue = 0;
+        while (nCount > 0) {
+            if (pch == pend)
+                throw std::ios_base::failure("BitStreamReader::Read(): end of data");
+            int nTake = std::min(8 - nOffset, nCount);
+            nValue = (nValue << nTake) | ((*pch >> (8 - nOffset - nTake)) & ((1 << nTake) - 1));
+            nOffset += nTake;
+            nCount -= nTake;
+            if (nOffset == 8) {
+                pch++;
+                nOffset = 0;
+            }
+        }
+        return nValue;
+    }
+};
+
+static void GolombRiceEncode(BitStreamWriter& writer, uint8_t P, uint64_t x)
+{
+    // quotient in unary, terminated by a zero bit
+    for (uint64_t q = x >> P; q > 0; q -= std::min<uint64_t>(q, 64))
+        writer.Write(~0ULL, std::min<uint64_t>(q, 64));
+    writer.Write(0, 1);
+    writer.Write(x, P);
+}
+
+static uint64_t GolombRiceDecode(BitStreamReader& reader, uint8_t P)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    return (q << P) + reader.Read(P);
+}
+
+//! (x * n) >> 64, maps a uniform 64 bit value to [0, n) without a division
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t lo_lo = x_lo * n_lo;
+    uint64_t lo_hi = x_lo * n_hi;
+    uint64_t hi_lo = x_hi * n_lo;
+    uint64_t hi_hi = x_hi * n_hi;
+    uint64_t mid = (lo_lo >> 32) + (lo_hi & 0xFFFFFFFF) + (hi_lo & 0xFFFFFFFF);
+    return hi_hi + (lo_hi >> 32) + (hi_lo >> 32) + (mid >> 32);
+#endif
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, uint8_t PIn, uint32_t MIn) : k0(k0In), k1(k1In), P(PIn), M(MIn), N(0), F(0)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(stream, N);
+    vEncoded.assign(stream.begin(), stream.end());
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, uint8_t PIn, uint32_t MIn, const std::vector<unsigned char>& vEncodedIn)
+    : k0(k0In), k1(k1In), P(PIn), M(MIn), vEncoded(vEncodedIn)
+{
+    CDataStream stream(vEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nElements = ReadCompactSize(stream);
+    if (nElements > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("N must be < 2^32");
+    N = nElements;
+    F = (uint64_t)N * M;
+
+    // Every element has to decode within the data
+    const unsigned char* pbegin = &vEncoded[0] + (vEncoded.size() - stream.size());
+    BitStreamReader reader(pbegin, &vEncoded[0] + vEncoded.size());
+    for (uint32_t i = 0; i < N; i++)
+        GolombRiceDecode(reader, P);
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, uint8_t PIn, uint32_t MIn, const ElementSet& elements)
+    : k0(k0In), k1(k1In), P(PIn), M(MIn)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("N must be < 2^32");
+    N = elements.size();
+    F = (uint64_t)N * M;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(stream, N);
+    vEncoded.assign(stream.begin(), stream.end());
+
+    BitStreamWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    std::vector<uint64_t> vHash = BuildHashedSet(elements);
+    for (size_t i = 0; i < vHash.size(); i++) {
+        GolombRiceEncode(writer, P, vHash[i] - nLast);
+        nLast = vHash[i];
+    }
+    writer.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = SipHash(k0, k1, element.empty() ? NULL : &element[0], element.size());
+    return MapIntoRange(hash, F);
+}
+
+std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHash;
+    vHash.reserve(elements.size());
+    for (ElementSet::const_iterator it = elements.begin(); it != elements.end(); ++it)
+        vHash.push_back(HashToRange(*it));
+    std::sort(vHash.begin(), vHash.end());
+    return vHash;
+}
+
+bool GCSFilter::MatchInternal(const std::vector<uint64_t>& vHash) const
+{
+    CDataStream stream(vEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(stream);
+    const unsigned char* pbegin = &vEncoded[0] + (vEncoded.size() - stream.size());
+    BitStreamReader reader(pbegin, &vEncoded[0] + vEncoded.size());
+
+    // Walk the sorted filter and the sorted query side by side
+    uint64_t nValue = 0;
+    size_t nQuery = 0;
+    for (uint32_t i = 0; i < N && nQuery < vHash.size(); i++) {
+        nValue += GolombRiceDecode(reader, P);
+        while (nQuery < vHash.size() && vHash[nQuery] < nValue)
+            nQuery++;
+        if (nQuery < vHash.size() && vHash[nQuery] == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    if (N == 0)
+        return false;
+    return MatchInternal(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (N == 0)
+        return false;
+    return MatchInternal(BuildHashedSet(elements));
+}
+
+BlockFilter::BlockFilter(uint8_t filterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vEncoded) : filterType(filterTypeIn), hashBlock(hashBlockIn)
+{
+    uint64_t k0, k1;
+    uint8_t P;
+    uint32_t M;
+    if (!BuildParams(k0, k1, P, M))
+        throw std::ios_base::failure("unknown filter type");
+    filter = GCSFilter(k0, k1, P, M, vEncoded);
+}
+
+BlockFilter::BlockFilter(uint8_t filterTypeIn, const CBlock& block) : filterType(filterTypeIn), hashBlock(block.GetHash())
+{
+    uint64_t k0, k1;
+    uint8_t P;
+    uint32_t M;
+    if (!BuildParams(k0, k1, P, M))
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(k0, k1, P, M, BasicFilterElements(block));
+}
+
+bool BlockFilter::BuildParams(uint64_t& k0, uint64_t& k1, uint8_t& P, uint32_t& M) const
+{
+    if (filterType != BASIC_FILTER)
+        return false;
+    // keyed by the block, so a false positive for one block says nothing about the next
+    k0 = ReadLE64(hashBlock.begin());
+    k1 = ReadLE64(hashBlock.begin() + 8);
+    P = BASIC_FILTER_P;
+    M = BASIC_FILTER_M;
+    return true;
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vEncoded = filter.GetEncoded();
+    return Hash(vEncoded.begin(), vEncoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), prevHeader.begin(), prevHeader.end());
+}
+
+GCSFilter::ElementSet BlockFilter::BasicFilterElements(const CBlock& block)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransaction& tx : block.vtx) {
+        for (const CTxOut& txout : tx.vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN || script.IsZerocoinMint())
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx.vin) {
+            if (txin.scriptSig.IsZerocoinSpend())
+                continue;
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << txin.prevout;
+            elements.insert(GCSFilter::Element(ss.begin(), ss.end()));
+        }
+    }
+    return elements;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+/**
+ * Golomb-Rice coded set (BIP 158). Every element is hashed with SipHash
+ * into the range [0, N * M), the sorted hashes are written as deltas with
+ * a Rice code of parameter P. Membership tests decode the whole filter,
+ * false positives occur at a rate of about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t k0;
+    uint64_t k1;
+    uint8_t P;
+    uint32_t M;
+    uint32_t N;
+    uint64_t F; //!< range of the element hashes, N * M
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    //! Whether any of the sorted hashes is in the filter
+    bool MatchInternal(const std::vector<uint64_t>& vHash) const;
+
+public:
+    GCSFilter(uint64_t k0In = 0, uint64_t k1In = 0, uint8_t PIn = 0, uint32_t MIn = 0);
+    //! Takes over an encoded filter, throws std::ios_base::failure if it is malformed
+    GCSFilter(uint64_t k0In, uint64_t k1In, uint8_t PIn, uint32_t MIn, const std::vector<unsigned char>& vEncodedIn);
+    GCSFilter(uint64_t k0In, uint64_t k1In, uint8_t PIn, uint32_t MIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return N; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    bool Match(const Element& element) const;
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType {
+    BASIC_FILTER = 0,
+};
+
+//! Golomb-Rice parameter and inverse false positive rate of basic filters
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+//! Most filters or filter hashes served for one getcfilters or getcfheaders request
+static const int MAX_GETCFILTERS_SIZE = 1000;
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+//! Block interval of the filter headers returned in cfcheckpt
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * Compact filter of one block for light clients. The basic filter holds
+ * every output script of the block and every outpoint its transactions
+ * spend, so a wallet finds both payments to it and spends of its coins
+ * without asking the server which addresses it cares about.
+ * Outpoints stand in for the spent scripts of BIP 158 so the filter is
+ * built from the block alone; zerocoin mints and spends are left out.
+ */
+class BlockFilter
+{
+private:
+    uint8_t filterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    bool BuildParams(uint64_t& k0, uint64_t& k1, uint8_t& P, uint32_t& M) const;
+
+public:
+    BlockFilter() : filterType(BASIC_FILTER) {}
+    //! Throws std::ios_base::failure if the type is unknown or the filter is malformed
+    BlockFilter(uint8_t filterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vEncoded);
+    BlockFilter(uint8_t filterTypeIn, const CBlock& block);
+
+    uint8_t GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    //! Double SHA256 of the encoded filter
+    uint256 GetHash() const;
+    //! Filter header committing to this filter and, through the previous header, all filters before it
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    //! Elements of the basic filter of a block
+    static GCSFilter::ElementSet BasicFilterElements(const CBlock& block);
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -71,8 +71,7 @@ bool CheckBlockSignature(const CBlock& block)
     CPubKey pubkey;
     bool fzZIJAStake = block.vtx[1].IsZerocoinSpend();
     if (fzZIJAStake) {
-        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(block.vtx[1].vin[0]);
-        pubkey = spend.getPubKey();
+        pubkey = TxInToZerocoinSpend(block.vtx[1], 0)->getPubKey();
     } else {
         txnouttype whichType;
         std::vector<valtype> vSolutions;
@@ -7,8 +7,10 @@
 
 #include "bloom.h"
 
+#include "crypto/common.h"
 #include "hash.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "streams.h"
@@ -191,3 +193,126 @@ void CBloomFilter::UpdateEmptyFull()
     isFull = full;
     isEmpty = empty;
 }
+
+CHashBloomFilter::CHashBloomFilter(unsigned int nElements, uint64_t nTweakIn) : nCapacity(std::max(nElements, 1u)),
+                                                                                nInserted(0),
+                                                                                nTweak(nTweakIn)
+{
+    nBlocks = (uint64_t)nCapacity * BITS_PER_ELEMENT / (BLOCK_WORDS * 64) + 1;
+    vData.assign((size_t)nBlocks * BLOCK_WORDS, 0);
+}
+
+void CHashBloomFilter::insert(const uint256& hash)
+{
+    const unsigned char* p = hash.begin();
+    uint64_t* block = &vData[((ReadLE64(p) ^ nTweak) % nBlocks) * BLOCK_WORDS];
+    uint64_t h1 = ReadLE64(p + 8) ^ nTweak;
+    uint64_t h2 = ReadLE64(p + 16) | 1;
+    for (unsigned int i = 0; i < HASH_FUNCS; i++) {
+        unsigned int nBit = (h1 + i * h2) & (BLOCK_WORDS * 64 - 1);
+        block[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+    nInserted++;
+}
+
+bool CHashBloomFilter::contains(const uint256& hash) const
+{
+    const unsigned char* p = hash.begin();
+    const uint64_t* block = &vData[((ReadLE64(p) ^ nTweak) % nBlocks) * BLOCK_WORDS];
+    uint64_t h1 = ReadLE64(p + 8) ^ nTweak;
+    uint64_t h2 = ReadLE64(p + 16) | 1;
+    for (unsigned int i = 0; i < HASH_FUNCS; i++) {
+        unsigned int nBit = (h1 + i * h2) & (BLOCK_WORDS * 64 - 1);
+        if (!(block[nBit >> 6] & ((uint64_t)1 << (nBit & 63))))
+            return false;
+    }
+    return true;
+}
+
+void CHashBloomFilter::clear()
+{
+    vData.assign(vData.size(), 0);
+    nInserted = 0;
+}
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double nFPRate)
+{
+    double logFpRate = log(nFPRate);
+    // The optimal number of hash functions is log(fpRate) / log(0.5), restricted to 1-50
+    nHashFuncs = std::max(1, std::min((int)round(logFpRate / log(0.5)), 50));
+    // Between two and three generations of nElements / 2 entries are remembered
+    nEntriesPerGeneration = (std::max(nElements, 2u) + 1) / 2;
+    uint32_t nMaxElements = nEntriesPerGeneration * 3;
+    // fpRate = (1 - exp(-nHashFuncs * nMaxElements / nFilterBits)) ^ nHashFuncs, solved for nFilterBits
+    uint32_t nFilterBits = (uint32_t)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(logFpRate / nHashFuncs)));
+    // Bit P of the filter is bit (P & 63) of both data[(P >> 6) * 2] and data[(P >> 6) * 2 + 1]
+    data.resize(((nFilterBits + 63) / 64) << 1);
+    reset();
+}
+
+uint64_t CRollingBloomFilter::Hash(const std::vector<unsigned char>& vKey) const
+{
+    return ((uint64_t)MurmurHash3((uint32_t)k0, vKey) << 32) | MurmurHash3((uint32_t)k1, vKey);
+}
+
+void CRollingBloomFilter::Insert(uint64_t nHash)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration) {
+        nEntriesThisGeneration = 0;
+        nGeneration++;
+        if (nGeneration == 4)
+            nGeneration = 1;
+        uint64_t nGenerationMask1 = 0 - (uint64_t)(nGeneration & 1);
+        uint64_t nGenerationMask2 = 0 - (uint64_t)(nGeneration >> 1);
+        // Wipe the entries of the generation that used this number before
+        for (size_t p = 0; p < data.size(); p += 2) {
+            uint64_t p1 = data[p], p2 = data[p + 1];
+            uint64_t mask = (p1 ^ nGenerationMask1) | (p2 ^ nGenerationMask2);
+            data[p] = p1 & mask;
+            data[p + 1] = p2 & mask;
+        }
+    }
+    nEntriesThisGeneration++;
+
+    uint64_t h2 = ((nHash >> 32) | (nHash << 32)) | 1;
+    for (int n = 0; n < nHashFuncs; n++) {
+        uint64_t h = nHash + n * h2;
+        int bit = h & 0x3F;
+        size_t pos = ((h >> 6) % (data.size() >> 1)) << 1;
+        data[pos] = (data[pos] & ~((uint64_t)1 << bit)) | ((uint64_t)(nGeneration & 1)) << bit;
+        data[pos + 1] = (data[pos + 1] & ~((uint64_t)1 << bit)) | ((uint64_t)(nGeneration >> 1)) << bit;
+    }
+}
+
+bool CRollingBloomFilter::Contains(uint64_t nHash) const
+{
+    uint64_t h2 = ((nHash >> 32) | (nHash << 32)) | 1;
+    for (int n = 0; n < nHashFuncs; n++) {
+        uint64_t h = nHash + n * h2;
+        int bit = h & 0x3F;
+        size_t pos = ((h >> 6) % (data.size() >> 1)) << 1;
+        // A bit is set if it carries any generation
+        if (!(((data[pos] | data[pos + 1]) >> bit) & 1))
+            return false;
+    }
+    return true;
+}
+
+void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    Insert(Hash(vKey));
+}
+
+bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return Contains(Hash(vKey));
+}
+
+void CRollingBloomFilter::reset()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    std::fill(data.begin(), data.end(), 0);
+}
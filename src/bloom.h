@@ -100,4 +100,77 @@ public:
     void UpdateEmptyFull();
 };
 
+/**
+ * Memory only bloom filter over keys that already are uniformly distributed
+ * hashes (e.g. zerocoin serial hashes). Instead of hashing the key again the
+ * words of the hash, mixed with a random tweak, select one 512 bit block and
+ * the bits set within it, so every insert or lookup touches a single cache
+ * line. Elements can not be removed; the owner rebuilds the filter when it
+ * holds more than the capacity it was sized for.
+ */
+class CHashBloomFilter
+{
+private:
+    static const unsigned int BLOCK_WORDS = 8;
+    static const unsigned int BITS_PER_ELEMENT = 12;
+    static const unsigned int HASH_FUNCS = 8;
+
+    std::vector<uint64_t> vData;
+    unsigned int nBlocks;
+    unsigned int nCapacity;
+    unsigned int nInserted;
+    uint64_t nTweak;
+
+public:
+    CHashBloomFilter(unsigned int nElements, uint64_t nTweakIn);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    void clear();
+
+    unsigned int GetCapacity() const { return nCapacity; }
+    unsigned int GetInserted() const { return nInserted; }
+    //! True once more elements were inserted than the filter was sized for
+    bool IsOverfull() const { return nInserted > nCapacity; }
+    size_t GetMemoryUsage() const { return vData.size() * sizeof(uint64_t); }
+};
+
+/**
+ * RollingBloomFilter is a probabilistic "keep track of most recently inserted"
+ * set, in memory fixed at construction. It remembers at least the last
+ * nElements inserted, and at most one and a half times that many.
+ *
+ * Entries are inserted in generations of nElements / 2. Every bit of the
+ * filter is stored as two bits holding the generation (1-3) that last set
+ * it, or 0 if unset; starting a fourth generation wipes the bits of the
+ * oldest one. Positions are derived from two keyed MurmurHash3 of the key
+ * by double hashing, with keys chosen at random on every reset so peers can
+ * not aim for false positives.
+ */
+class CRollingBloomFilter
+{
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    void insert(const std::vector<unsigned char>& vKey);
+    bool contains(const std::vector<unsigned char>& vKey) const;
+
+    //! Forget everything and pick new hash keys
+    void reset();
+
+    size_t GetMemoryUsage() const { return data.size() * sizeof(uint64_t); }
+
+private:
+    unsigned int nEntriesPerGeneration;
+    unsigned int nEntriesThisGeneration;
+    int nGeneration;
+    std::vector<uint64_t> data;
+    uint64_t k0, k1;
+    int nHashFuncs;
+
+    uint64_t Hash(const std::vector<unsigned char>& vKey) const;
+    void Insert(uint64_t nHash);
+    bool Contains(uint64_t nHash) const;
+};
+
 #endif // BITCOIN_BLOOM_H
@@ -16,6 +16,9 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <array>
+#include <map>
+#include <stdexcept>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -122,9 +125,6 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //ppcoin: trust score of block chain
-    uint256 bnChainTrust;
-
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -165,7 +165,6 @@ public:
     unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
     COutPoint prevoutStake;
     unsigned int nStakeTime;
-    uint256 hashProofOfStake;
     int64_t nMint;
     int64_t nMoneySupply;
 
@@ -180,10 +179,12 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
-    
+    //! zerocoin specific fields, indexed by position in libzerocoin::zerocoinDenomList
+    //! Supply of each denomination up to and including this block
+    std::array<int64_t, libzerocoin::ZEROCOIN_DENOM_COUNT> nZerocoinSupply;
+    //! Number of mints of each denomination in this block
+    std::array<uint16_t, libzerocoin::ZEROCOIN_DENOM_COUNT> nMintsInBlock;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -214,10 +215,8 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        nZerocoinSupply.fill(0);
+        nMintsInBlock.fill(0);
     }
 
     CBlockIndex()
@@ -238,13 +237,11 @@ public:
             nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
 
         //Proof of Stake
-        bnChainTrust = uint256();
         nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
-        hashProofOfStake = uint256();
 
         if (block.IsProofOfStake()) {
             SetProofOfStake();
@@ -291,18 +288,46 @@ public:
         return block;
     }
 
+    static int ZerocoinDenomIndex(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range("CBlockIndex: invalid zerocoin denomination");
+        return nIndex;
+    }
+
     int64_t GetZerocoinSupply() const
     {
         int64_t nTotal = 0;
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * mapZerocoinSupply.at(denom);
+            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * GetZerocoinSupply(denom);
         }
         return nTotal;
     }
 
+    int64_t GetZerocoinSupply(libzerocoin::CoinDenomination denom) const
+    {
+        return nZerocoinSupply[ZerocoinDenomIndex(denom)];
+    }
+
+    void SetZerocoinSupply(libzerocoin::CoinDenomination denom, int64_t nSupply)
+    {
+        nZerocoinSupply[ZerocoinDenomIndex(denom)] = nSupply;
+    }
+
+    int GetMintCount(libzerocoin::CoinDenomination denom) const
+    {
+        return nMintsInBlock[ZerocoinDenomIndex(denom)];
+    }
+
+    void AddMint(libzerocoin::CoinDenomination denom)
+    {
+        nMintsInBlock[ZerocoinDenomIndex(denom)]++;
+    }
+
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return GetMintCount(denom) > 0;
     }
 
     uint256 GetBlockHash() const
@@ -468,7 +493,6 @@ public:
         } else {
             const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
             const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-            const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = uint256();
         }
 
         // block header
@@ -481,8 +505,28 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
+
+            // The zerocoin fields keep their map/vector disk format
+            std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+            std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+            if (!ser_action.ForRead()) {
+                for (auto& denom : libzerocoin::zerocoinDenomList) {
+                    mapZerocoinSupply.insert(std::make_pair(denom, GetZerocoinSupply(denom)));
+                    vMintDenominationsInBlock.insert(vMintDenominationsInBlock.end(), GetMintCount(denom), denom);
+                }
+            }
             READWRITE(mapZerocoinSupply);
             READWRITE(vMintDenominationsInBlock);
+            if (ser_action.ForRead()) {
+                for (auto& it : mapZerocoinSupply) {
+                    if (libzerocoin::ZerocoinDenominationToIndex(it.first) >= 0)
+                        SetZerocoinSupply(it.first, it.second);
+                }
+                for (auto& denom : vMintDenominationsInBlock) {
+                    if (libzerocoin::ZerocoinDenominationToIndex(denom) >= 0)
+                        AddMint(denom);
+                }
+            }
         }
 
     }
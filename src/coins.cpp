@@ -65,7 +65,16 @@ bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return fal
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
 bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+void CCoinsView::GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const
+{
+    CCoins coins;
+    for (const uint256& txid : vTxid) {
+        if (GetCoins(txid, coins))
+            vCoins.push_back(std::make_pair(txid, coins));
+    }
+}
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
+bool CCoinsView::GetRunningStats(CCoinsStats& stats) const { return false; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
@@ -74,7 +83,9 @@ bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveC
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+void CCoinsViewBacked::GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const { base->GetCoinsBatch(vTxid, vCoins); }
 bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetRunningStats(CCoinsStats& stats) const { return base->GetRunningStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -103,6 +114,38 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256& txid) const
     return ret;
 }
 
+void CCoinsViewCache::GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const
+{
+    std::vector<uint256> vMissing;
+    for (const uint256& txid : vTxid) {
+        CCoinsMap::const_iterator it = cacheCoins.find(txid);
+        if (it != cacheCoins.end())
+            vCoins.push_back(std::make_pair(txid, it->second.coins));
+        else
+            vMissing.push_back(txid);
+    }
+    if (vMissing.empty())
+        return;
+
+    size_t nFirst = vCoins.size();
+    base->GetCoinsBatch(vMissing, vCoins);
+    for (size_t i = nFirst; i < vCoins.size(); i++) {
+        // Same bookkeeping as FetchCoins()
+        std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(vCoins[i].first, CCoinsCacheEntry()));
+        if (!ret.second)
+            continue;
+        ret.first->second.coins = vCoins[i].second;
+        if (ret.first->second.coins.IsPruned())
+            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+}
+
+void CCoinsViewCache::PrefetchCoins(const std::vector<uint256>& vTxid) const
+{
+    std::vector<std::pair<uint256, CCoins> > vCoins;
+    GetCoinsBatch(vTxid, vCoins);
+}
+
 bool CCoinsViewCache::GetCoins(const uint256& txid, CCoins& coins) const
 {
     CCoinsMap::const_iterator it = FetchCoins(txid);
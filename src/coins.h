@@ -328,9 +328,10 @@ struct CCoinsStats {
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), hashMuHash(0), nTotalAmount(0) {}
 };
 
 
@@ -345,6 +346,9 @@ public:
     //! This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256& txid) const;
 
+    //! Retrieve the CCoins for many txids at once, appending those found to vCoins
+    virtual void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const;
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -355,6 +359,10 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! Retrieve incrementally maintained statistics without scanning the set.
+    //! Returns false if they are not available (hashSerialized is left unset).
+    virtual bool GetRunningStats(CCoinsStats& stats) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -370,10 +378,12 @@ public:
     CCoinsViewBacked(CCoinsView* viewIn);
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
+    void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetRunningStats(CCoinsStats& stats) const;
 };
 
 class CCoinsViewCache;
@@ -431,6 +441,7 @@ public:
     // Standard CCoinsView methods
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
+    void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256& hashBlock);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
@@ -442,6 +453,13 @@ public:
      */
     const CCoins* AccessCoins(const uint256& txid) const;
 
+    /**
+     * Pull the entries for all given txids into this cache (and every cache
+     * below it) with a single batched lookup in the backing database, so
+     * that later single lookups do not each wait for the disk.
+     */
+    void PrefetchCoins(const std::vector<uint256>& vTxid) const;
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
@@ -18,6 +18,7 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockencodings.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "httpserver.h"
@@ -29,9 +30,12 @@
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
+#include "messagedispatch.h"
 #include "miner.h"
 #include "net.h"
+#include "obfuscation-sigcheck.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "spork.h"
@@ -166,10 +170,19 @@ public:
             abort();
         }
     }
+    void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const
+    {
+        try {
+            CCoinsViewBacked::GetCoinsBatch(vTxid, vCoins);
+        } catch (const std::runtime_error& e) {
+            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+            LogPrintf("Error reading from database: %s\n", e.what());
+            abort();
+        }
+    }
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -235,6 +248,8 @@ void PrepareShutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsWriteBehind;
+        pcoinsWriteBehind = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -243,6 +258,8 @@ void PrepareShutdown()
         pblocktree = NULL;
         delete zerocoinDB;
         zerocoinDB = NULL;
+        delete pblockfilterdb;
+        pblockfilterdb = NULL;
         delete pSporkDB;
         pSporkDB = NULL;
     }
@@ -362,8 +379,11 @@ std::string HelpMessage(HelpMessageMode mode)
     string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
+    strUsage += HelpMessageOpt("-accvaluecache=<n>", strprintf(_("Number of decoded accumulator values kept in memory (default: %u)"), DEFAULT_ACCUMULATOR_VALUE_CACHE));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write the chainstate to disk on a background thread while validation continues; the coin cache gets half of its -dbcache share to make room for the entries being written (default: %u)"), DEFAULT_ASYNC_FLUSH));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain compact filters of all blocks and serve them to light clients (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
@@ -374,7 +394,11 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
+    strUsage += HelpMessageOpt("-dbbloombits=[<db>:]<n>", strprintf(_("Bits per key of database bloom filters, 0 to disable (default: %u)"), 10));
+    strUsage += HelpMessageOpt("-dbblocksize=[<db>:]<n>", strprintf(_("Size in bytes of database table blocks (default: %u). <db> is one of blockindex, chainstate, zerocoin or sporks and may be omitted to apply to all; can be specified multiple times"), 4096));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbmaxopenfiles=[<db>:]<n>", strprintf(_("Maximum number of table files a database keeps open (default: %u)"), 64));
+    strUsage += HelpMessageOpt("-dbwritebuffer=[<db>:]<n>", _("Size in megabytes of database write buffers (default: a quarter of the database cache)"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -391,12 +415,14 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-zerocoinfilter", strprintf(_("Keep an in-memory filter of spent serials and minted pubcoins to skip database lookups of unknown ones (default: %u)"), DEFAULT_ZEROCOIN_FILTER));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Relay new blocks as header and short transaction ids, rebuilt from the mempool (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP address (default: 1 when listening and no -externalip)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -408,6 +434,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), 125));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), blocks older than a week are no longer served to peers once it is reached, 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
@@ -415,6 +442,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 17009, 17111));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
+    strUsage += HelpMessageOpt("-rawblockcache=<n>", strprintf(_("Keep up to <n> MiB of recently served blocks in memory to answer other peers asking for them (default: %u)"), DEFAULT_RAW_BLOCK_CACHE));
+    strUsage += HelpMessageOpt("-relaycache=<n>", strprintf(_("Keep up to <n> MiB of relayed transactions in memory to answer peers asking for them (default: %u)"), DEFAULT_RELAY_CACHE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
@@ -443,6 +472,7 @@ std::string HelpMessage(HelpMessageMode mode)
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in ZIJA/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading blocks ahead during a wallet rescan (0 = one per core, up to %d, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -501,7 +531,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-maxsigcachemb=<n>", strprintf(_("Limit size of signature cache to <n> MiB (%d to %d, default: %u)"), 0, MAX_MAX_SIG_CACHE_SIZE, DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in ZIJA/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0));
@@ -534,6 +564,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "173.249.48.233:17009"));
+    strUsage += HelpMessageOpt("-msgdispatchthreads=<n>", strprintf(_("Set the number of threads serving masternode payment and budget sync requests, 0 processes them with all other messages (0 to %d, default: %d)"), MAX_MSGDISPATCH_THREADS, DEFAULT_MSGDISPATCH_THREADS));
+    strUsage += HelpMessageOpt("-msgsigcheckthreads=<n>", strprintf(_("Set the number of threads pre-verifying masternode, budget and SwiftX message signatures (0 to %d, default: %d)"), MAX_MSGSIGCHECK_THREADS, DEFAULT_MSGSIGCHECK_THREADS));
     strUsage += HelpMessageOpt("-budgetvotemode=<mode>", _("Change automatic finalized budget voting behavior. mode=auto: Vote for only exact finalized budget match to my generated budget. (string, default: auto)"));
 
     strUsage += HelpMessageGroup(_("Zerocoin options:"));
@@ -895,10 +927,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-benchmark", false))
         InitWarning(_("Warning: Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    // -maxsigcachesize counted entries, the cache is now sized in MiB
+    if (mapArgs.count("-maxsigcachesize"))
+        InitWarning(_("Warning: Unsupported argument -maxsigcachesize ignored, use -maxsigcachemb."));
+
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
+    fCompactBlocks = GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS);
+    rawBlockCache.SetMaxBytes(std::max(GetArg("-rawblockcache", DEFAULT_RAW_BLOCK_CACHE), (int64_t)0) << 20);
+    nMaxRelayCacheSize = std::max(GetArg("-relaycache", DEFAULT_RELAY_CACHE), (int64_t)0) << 20;
+    CNode::SetMaxOutboundTarget(std::max(GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET), (int64_t)0) << 20);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -989,6 +1029,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices |= NODE_BLOOM;
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        nLocalServices |= NODE_COMPACT_FILTERS;
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
@@ -1000,6 +1042,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. ZIJA Core is shutting down."));
 
+    InitSignatureCache();
+
     std::string strDataDir = GetDataDir().string();
 #ifdef ENABLE_WALLET
     // Wallet file must be a plain filename without a directory
@@ -1040,6 +1084,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
+    for (int i = 0; i < BATCH_READ_THREADS - 1; i++)
+        threadGroup.create_thread(&ThreadBatchRead);
 
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
@@ -1380,8 +1426,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    size_t nZerocoinDBCache = std::min(nTotalCache / 16, (size_t)(8 << 20)); // serial and mint lookups on every zerocoin transaction
+    nTotalCache -= nZerocoinDBCache;
+    size_t nBlockFilterDBCache = 0;
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        nBlockFilterDBCache = std::min(nTotalCache / 16, (size_t)(4 << 20)); // recent filters, the ones light clients ask for
+        nTotalCache -= nBlockFilterDBCache;
+    }
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
+    if (GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH))
+        nTotalCache /= 2; // the entries being written in the background are held in memory until they are on disk
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
 
     bool fLoaded = false;
@@ -1396,20 +1451,31 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsWriteBehind;
+                pcoinsWriteBehind = NULL;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
                 delete zerocoinDB;
+                delete pblockfilterdb;
+                pblockfilterdb = NULL;
                 delete pSporkDB;
 
                 //ZIJA specific: zerocoin and spork DB's
-                zerocoinDB = new CZerocoinDB(0, false, fReindex);
+                zerocoinDB = new CZerocoinDB(nZerocoinDBCache, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
+                if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+                    pblockfilterdb = new CBlockFilterDB(nBlockFilterDBCache, false, fReindex);
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                if (GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH)) {
+                    pcoinsWriteBehind = new CCoinsViewWriteBehind(pcoinscatcher, pblocktree);
+                    pcoinsTip = new CCoinsViewCache(pcoinsWriteBehind);
+                } else {
+                    pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                }
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
@@ -1418,6 +1484,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
 
+                if (GetBoolArg("-zerocoinfilter", DEFAULT_ZEROCOIN_FILTER)) {
+                    uiInterface.InitMessage(_("Loading zerocoin filters..."));
+                    if (!zerocoinDB->LoadFilters()) {
+                        strLoadError = _("Error loading zerocoin database");
+                        break;
+                    }
+                }
+
                 uiInterface.InitMessage(_("Loading block index..."));
                 string strBlockIndexError = "";
                 if (!LoadBlockIndex(strBlockIndexError)) {
@@ -1443,6 +1517,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -blockfilterindex state
+                if (fBlockFilterIndex != GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -blockfilterindex");
+                    break;
+                }
+
                 // Populate list of invalid/fraudulent outpoints that are banned from the chain
                 invalid_out::LoadOutpoints();
                 invalid_out::LoadSerials();
@@ -1490,13 +1570,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                 }
 
+                // Recent checkpoints are what spends and stakes refer to
+                accumulatorValueCache.SetMaxEntries(std::max(GetArg("-accvaluecache", DEFAULT_ACCUMULATOR_VALUE_CACHE), (int64_t)libzerocoin::zerocoinDenomList.size()));
+                WarmAccumulatorValueCache(chainActive.Tip(), ACCUMULATOR_CACHE_WARM_CHECKPOINTS);
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
 
                 // Flag sent to validation code to let it know it can skip certain checks
                 fVerifyingBlocks = true;
 
-                // Zerocoin must check at level 4
-                if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", 100))) {
+                // Zerocoin must check at level 4; read through the background writer
+                // so that coins still being written are seen
+                CCoinsView* pcoinsverify = pcoinsWriteBehind ? (CCoinsView*)pcoinsWriteBehind : pcoinsdbview;
+                if (!CVerifyDB().VerifyDB(pcoinsverify, 4, GetArg("-checkblocks", 100))) {
                     strLoadError = _("Corrupted block database detected");
                     fVerifyingBlocks = false;
                     break;
@@ -1640,6 +1726,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pindexRescan = FindForkInGlobalIndex(chainActive, locator);
             else
                 pindexRescan = chainActive.Genesis();
+
+            // Resume a rescan that was interrupted by a shutdown
+            if (walletdb.ReadRescanPos(locator)) {
+                CBlockIndex* pindexResume = FindForkInGlobalIndex(chainActive, locator);
+                if (pindexResume && (!pindexRescan || pindexResume->nHeight < pindexRescan->nHeight)) {
+                    LogPrintf("Resuming interrupted rescan at block %d\n", pindexResume->nHeight);
+                    pindexRescan = pindexResume;
+                }
+            }
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
             uiInterface.InitMessage(_("Rescanning..."));
@@ -1881,6 +1976,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     threadGroup.create_thread(boost::bind(&ThreadCheckObfuScationPool));
 
+    if (!fLiteMode) {
+        InitMessageSigCache();
+
+        int nMessageSigCheckThreads = std::min(std::max((int)GetArg("-msgsigcheckthreads", DEFAULT_MSGSIGCHECK_THREADS), 0), MAX_MSGSIGCHECK_THREADS);
+        LogPrintf("Using %d threads for masternode message signature verification\n", nMessageSigCheckThreads);
+        for (int i = 0; i < nMessageSigCheckThreads; i++)
+            threadGroup.create_thread(&ThreadMessageSigCheck);
+
+        int nMessageDispatchThreads = std::min(std::max((int)GetArg("-msgdispatchthreads", DEFAULT_MSGDISPATCH_THREADS), 0), MAX_MSGDISPATCH_THREADS);
+        LogPrintf("Using %d threads for masternode message processing\n", nMessageDispatchThreads);
+        for (int i = 0; i < nMessageDispatchThreads; i++)
+            threadGroup.create_thread(&ThreadMessageDispatch);
+    }
+
     // ********************************************************* Step 11: start node
 
     if (!CheckDiskSpace())
@@ -357,7 +357,8 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::uniqu
 
     //Construct the stakeinput object
     if (tx.IsZerocoinSpend()) {
-        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
+        std::shared_ptr<const libzerocoin::CoinSpend> pspend = TxInToZerocoinSpend(tx, 0);
+        const libzerocoin::CoinSpend& spend = *pspend;
         if (spend.getSpendType() != libzerocoin::SpendType::STAKE)
             return error("%s: spend is using the wrong SpendType (%d)", __func__, (int)spend.getSpendType());
 
@@ -412,6 +413,15 @@ bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx)
     return (nTimeBlock == nTimeTx);
 }
 
+// Proof-of-stake hash of a block, kept in mapProofOfStake instead of on the block index
+static uint256 GetProofOfStakeHash(const CBlockIndex* pindex)
+{
+    if (!pindex->IsProofOfStake())
+        return 0;
+    std::map<uint256, uint256>::const_iterator it = mapProofOfStake.find(pindex->GetBlockHash());
+    return it != mapProofOfStake.end() ? it->second : 0;
+}
+
 // Get stake modifier checksum
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
 {
@@ -420,7 +430,7 @@ unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
     CDataStream ss(SER_GETHASH, 0);
     if (pindex->pprev)
         ss << pindex->pprev->nStakeModifierChecksum;
-    ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
+    ss << pindex->nFlags << GetProofOfStakeHash(pindex) << pindex->nStakeModifier;
     uint256 hashChecksum = Hash(ss.begin(), ss.end());
     hashChecksum >>= (256 - 32);
     return hashChecksum.Get64();
@@ -4,9 +4,16 @@
 
 #include "leveldbwrapper.h"
 
+#include "checkqueue.h"
+#include "sync.h"
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+#include <numeric>
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +34,132 @@ void HandleError(const leveldb::Status& status) throw(leveldb_error)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace
+{
+/** Open databases by name, for getleveldbinfo */
+CCriticalSection cs_leveldbs;
+std::map<std::string, CLevelDBWrapper*> mapLevelDBs;
+
+/** Keys per thread below which a batch read is done on the calling thread */
+const size_t BATCH_READ_KEYS_PER_THREAD = 32;
+
+/** Compares the indexes of a batch read by the key they refer to */
+struct CRawKeyOrder {
+    const std::vector<std::string>& vKeys;
+    explicit CRawKeyOrder(const std::vector<std::string>& vKeysIn) : vKeys(vKeysIn) {}
+    bool operator()(size_t a, size_t b) const { return vKeys[a] < vKeys[b]; }
+};
+
+/** Read the keys vOrder[nBegin..nEnd) of a batch; keeps the first unexpected error in status */
+void ReadRawRange(leveldb::DB* pdb, const leveldb::ReadOptions& options, const std::vector<std::string>& vKeys, const std::vector<size_t>& vOrder, size_t nBegin, size_t nEnd, std::vector<std::string>* pvValues, std::vector<char>* pvHave, leveldb::Status* pstatus)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        size_t n = vOrder[i];
+        leveldb::Status status = pdb->Get(options, vKeys[n], &(*pvValues)[n]);
+        if (status.ok())
+            (*pvHave)[n] = 1;
+        else if (!status.IsNotFound() && pstatus->ok())
+            *pstatus = status;
+    }
+}
+
+/** A contiguous run of the sorted keys of a batch read, as a job for the batch read workers */
+class CBatchReadJob
+{
+private:
+    leveldb::DB* pdb;
+    const leveldb::ReadOptions* poptions;
+    const std::vector<std::string>* pvKeys;
+    const std::vector<size_t>* pvOrder;
+    size_t nBegin;
+    size_t nEnd;
+    std::vector<std::string>* pvValues;
+    std::vector<char>* pvHave;
+    leveldb::Status* pstatus;
+
+public:
+    CBatchReadJob() : pdb(NULL), poptions(NULL), pvKeys(NULL), pvOrder(NULL), nBegin(0), nEnd(0), pvValues(NULL), pvHave(NULL), pstatus(NULL) {}
+    CBatchReadJob(leveldb::DB* pdbIn, const leveldb::ReadOptions& options, const std::vector<std::string>& vKeys, const std::vector<size_t>& vOrder, size_t nBeginIn, size_t nEndIn, std::vector<std::string>* pvValuesIn, std::vector<char>* pvHaveIn, leveldb::Status* pstatusIn) : pdb(pdbIn), poptions(&options), pvKeys(&vKeys), pvOrder(&vOrder), nBegin(nBeginIn), nEnd(nEndIn), pvValues(pvValuesIn), pvHave(pvHaveIn), pstatus(pstatusIn) {}
+
+    bool operator()()
+    {
+        // Errors are reported through pstatus, so the other jobs go on
+        ReadRawRange(pdb, *poptions, *pvKeys, *pvOrder, nBegin, nEnd, pvValues, pvHave, pstatus);
+        return true;
+    }
+
+    void swap(CBatchReadJob& job)
+    {
+        std::swap(pdb, job.pdb);
+        std::swap(poptions, job.poptions);
+        std::swap(pvKeys, job.pvKeys);
+        std::swap(pvOrder, job.pvOrder);
+        std::swap(nBegin, job.nBegin);
+        std::swap(nEnd, job.nEnd);
+        std::swap(pvValues, job.pvValues);
+        std::swap(pvHave, job.pvHave);
+        std::swap(pstatus, job.pstatus);
+    }
+};
+
+CCheckQueue<CBatchReadJob> batchreadqueue(1);
+//! Held by the batch read using batchreadqueue; a concurrent one reads on its own thread
+CCriticalSection cs_batchreadqueue;
+
+/** Find the value of a -db* override for the database strName; a
+ *  "<name>:<value>" entry takes precedence over a plain "<value>" */
+bool GetLevelDBArg(const std::string& strArg, const std::string& strName, std::string& strValue)
+{
+    std::map<std::string, std::vector<std::string> >::const_iterator it = mapMultiArgs.find(strArg);
+    if (it == mapMultiArgs.end())
+        return false;
+
+    bool fFound = false;
+    BOOST_FOREACH (const std::string& strEntry, it->second) {
+        size_t nPos = strEntry.find(':');
+        if (nPos == std::string::npos) {
+            strValue = strEntry;
+            fFound = true;
+        } else if (!strName.empty() && strEntry.substr(0, nPos) == strName) {
+            strValue = strEntry.substr(nPos + 1);
+            return true;
+        }
+    }
+    return fFound;
+}
+} // anonymous namespace
+
+CLevelDBOptions::CLevelDBOptions(const std::string& strNameIn) : strName(strNameIn),
+                                                                 nBlockSize(4096),
+                                                                 nWriteBufferSize(0),
+                                                                 nMaxOpenFiles(64),
+                                                                 nBloomBits(10)
+{
+}
+
+void CLevelDBOptions::ApplyArgs()
+{
+    std::string strValue;
+    if (GetLevelDBArg("-dbblocksize", strName, strValue))
+        nBlockSize = std::max((int64_t)1024, atoi64(strValue));
+    if (GetLevelDBArg("-dbwritebuffer", strName, strValue))
+        nWriteBufferSize = std::max((int64_t)0, atoi64(strValue)) << 20;
+    if (GetLevelDBArg("-dbmaxopenfiles", strName, strValue))
+        nMaxOpenFiles = std::max(20, atoi(strValue));
+    if (GetLevelDBArg("-dbbloombits", strName, strValue))
+        nBloomBits = std::max(0, atoi(strValue));
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CLevelDBOptions& dbopts)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = dbopts.nWriteBufferSize ? dbopts.nWriteBufferSize : nCacheSize / 4;
+    options.block_size = dbopts.nBlockSize;
+    options.filter_policy = dbopts.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dbopts.nBloomBits) : NULL;
     options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.max_open_files = dbopts.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +168,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBOptions& dboptsIn) : dbopts(dboptsIn), strPath(path.string())
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    dbopts.ApplyArgs();
+    options = GetOptions(nCacheSize, dbopts);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -66,10 +192,23 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint("leveldb", "LevelDB %s: block size %u, write buffer %u, max open files %d, bloom bits %d\n",
+        dbopts.strName, options.block_size, options.write_buffer_size, options.max_open_files, dbopts.nBloomBits);
+
+    if (!dbopts.strName.empty()) {
+        LOCK(cs_leveldbs);
+        mapLevelDBs[dbopts.strName] = this;
+    }
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    if (!dbopts.strName.empty()) {
+        LOCK(cs_leveldbs);
+        std::map<std::string, CLevelDBWrapper*>::iterator it = mapLevelDBs.find(dbopts.strName);
+        if (it != mapLevelDBs.end() && it->second == this)
+            mapLevelDBs.erase(it);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -86,3 +225,105 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync) throw(leveldb
     HandleError(status);
     return true;
 }
+
+void CLevelDBWrapper::ReadRawBatch(const std::vector<std::string>& vKeys, std::vector<std::string>& vValues, std::vector<char>& vHave) const throw(leveldb_error)
+{
+    vValues.assign(vKeys.size(), std::string());
+    vHave.assign(vKeys.size(), 0);
+    if (vKeys.empty())
+        return;
+
+    std::vector<size_t> vOrder(vKeys.size());
+    std::iota(vOrder.begin(), vOrder.end(), 0);
+    std::sort(vOrder.begin(), vOrder.end(), CRawKeyOrder(vKeys));
+
+    leveldb::ReadOptions options = readoptions;
+    options.snapshot = pdb->GetSnapshot();
+
+    size_t nJobs = std::min((size_t)BATCH_READ_THREADS, vKeys.size() / BATCH_READ_KEYS_PER_THREAD);
+    std::vector<leveldb::Status> vStatus(std::max((size_t)1, nJobs));
+    TRY_LOCK(cs_batchreadqueue, lockQueue);
+    if (nJobs <= 1 || !lockQueue) {
+        ReadRawRange(pdb, options, vKeys, vOrder, 0, vOrder.size(), &vValues, &vHave, &vStatus[0]);
+    } else {
+        // Each job takes a contiguous run of the sorted keys; this thread
+        // works through the queue along with the workers until it is empty
+        CCheckQueueControl<CBatchReadJob> control(&batchreadqueue);
+        std::vector<CBatchReadJob> vJobs;
+        vJobs.reserve(nJobs);
+        size_t nPerJob = (vOrder.size() + nJobs - 1) / nJobs;
+        for (size_t t = 0; t < nJobs; t++) {
+            size_t nBegin = t * nPerJob;
+            size_t nEnd = std::min(vOrder.size(), nBegin + nPerJob);
+            vJobs.push_back(CBatchReadJob(pdb, options, vKeys, vOrder, nBegin, nEnd, &vValues, &vHave, &vStatus[t]));
+        }
+        control.Add(vJobs);
+        control.Wait();
+    }
+    pdb->ReleaseSnapshot(options.snapshot);
+
+    BOOST_FOREACH (const leveldb::Status& status, vStatus) {
+        if (!status.ok()) {
+            LogPrintf("LevelDB batch read failure: %s\n", status.ToString());
+            HandleError(status);
+        }
+    }
+}
+
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+CLevelDBStatus CLevelDBWrapper::GetStatus() const
+{
+    CLevelDBStatus status;
+    status.options = dbopts;
+    status.strPath = strPath;
+
+    // All keys in our databases start with a single type character
+    leveldb::Range range(leveldb::Slice("", 0), leveldb::Slice("\xff\xff", 2));
+    pdb->GetApproximateSizes(&range, 1, &status.nApproximateSize);
+
+    for (int nLevel = 0;; nLevel++) {
+        std::string strValue;
+        if (!GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue))
+            break;
+        status.vFilesPerLevel.push_back(atoi(strValue));
+    }
+    return status;
+}
+
+void ThreadBatchRead()
+{
+    RenameThread("zija-dbread");
+    batchreadqueue.Thread();
+}
+
+std::vector<std::string> ListLevelDBs()
+{
+    LOCK(cs_leveldbs);
+    std::vector<std::string> vNames;
+    for (std::map<std::string, CLevelDBWrapper*>::const_iterator it = mapLevelDBs.begin(); it != mapLevelDBs.end(); ++it)
+        vNames.push_back(it->first);
+    return vNames;
+}
+
+bool GetLevelDBStatus(const std::string& strName, CLevelDBStatus& status)
+{
+    LOCK(cs_leveldbs);
+    std::map<std::string, CLevelDBWrapper*>::const_iterator it = mapLevelDBs.find(strName);
+    if (it == mapLevelDBs.end())
+        return false;
+    status = it->second->GetStatus();
+    return true;
+}
+
+bool GetLevelDBProperty(const std::string& strName, const std::string& strProperty, std::string& strValue)
+{
+    LOCK(cs_leveldbs);
+    std::map<std::string, CLevelDBWrapper*>::const_iterator it = mapLevelDBs.find(strName);
+    if (it == mapLevelDBs.end())
+        return false;
+    return it->second->GetProperty(strProperty, strValue);
+}
@@ -9,6 +9,7 @@
 #include "serialize.h"
 #include "streams.h"
 #include "util.h"
+#include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/filesystem/path.hpp>
@@ -24,6 +25,52 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(leveldb_error);
 
+/**
+ * Tuning of a single LevelDB instance. The defaults reproduce the settings
+ * every database used to share; each value can be overridden at startup
+ * with -db<option>=<value> for all databases or -db<option>=<name>:<value>
+ * for the database called strName.
+ */
+struct CLevelDBOptions {
+    //! short name used for overrides and in getleveldbinfo
+    std::string strName;
+    //! approximate size of user data packed per table block
+    size_t nBlockSize;
+    //! size of each memtable, 0 to use a quarter of the cache size
+    size_t nWriteBufferSize;
+    //! number of table files LevelDB may keep open
+    int nMaxOpenFiles;
+    //! bits per key of the bloom filter policy, 0 disables the filter
+    int nBloomBits;
+
+    explicit CLevelDBOptions(const std::string& strNameIn = "");
+
+    //! Apply the -dbblocksize, -dbwritebuffer, -dbmaxopenfiles and -dbbloombits overrides
+    void ApplyArgs();
+};
+
+/** Point-in-time status of an open database, see GetLevelDBStatus() */
+struct CLevelDBStatus {
+    CLevelDBOptions options;
+    std::string strPath;
+    uint64_t nApproximateSize;
+    std::vector<int> vFilesPerLevel;
+
+    CLevelDBStatus() : nApproximateSize(0) {}
+};
+
+/** Names of all currently open (named) databases */
+std::vector<std::string> ListLevelDBs();
+/** Options, size and per-level file counts of an open database */
+bool GetLevelDBStatus(const std::string& strName, CLevelDBStatus& status);
+/** Query a leveldb::DB::GetProperty() value (e.g. "leveldb.stats") of an open database */
+bool GetLevelDBProperty(const std::string& strName, const std::string& strProperty, std::string& strValue);
+
+/** Number of threads, the reading one included, a large batch read is spread over */
+static const int BATCH_READ_THREADS = 4;
+/** Run a worker of the batch read queue; start BATCH_READ_THREADS - 1 of them */
+void ThreadBatchRead();
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -85,8 +132,14 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! tuning this database was opened with
+    CLevelDBOptions dbopts;
+
+    //! location on disk, reported by getleveldbinfo
+    std::string strPath;
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBOptions& dboptsIn = CLevelDBOptions());
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
@@ -114,6 +167,51 @@ public:
         return true;
     }
 
+    /**
+     * Look up many keys at once against a single snapshot. The keys are
+     * sorted so that neighbouring lookups share table blocks, and large
+     * batches are spread over the ThreadBatchRead() workers to overlap disk
+     * latency.
+     * Every key that was found is appended to vFound with its value.
+     * Returns false if a found value could not be deserialized; such keys
+     * are logged and left out of vFound.
+     */
+    template <typename K, typename V>
+    bool ReadBatch(const std::vector<K>& vKeys, std::vector<std::pair<K, V> >& vFound) const throw(leveldb_error)
+    {
+        std::vector<std::string> vRawKeys;
+        vRawKeys.reserve(vKeys.size());
+        for (typename std::vector<K>::const_iterator it = vKeys.begin(); it != vKeys.end(); ++it) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(ssKey.GetSerializeSize(*it));
+            ssKey << *it;
+            vRawKeys.push_back(ssKey.str());
+        }
+
+        std::vector<std::string> vRawValues;
+        std::vector<char> vHave;
+        ReadRawBatch(vRawKeys, vRawValues, vHave);
+
+        bool fAllRead = true;
+        for (size_t i = 0; i < vKeys.size(); i++) {
+            if (!vHave[i])
+                continue;
+            try {
+                CDataStream ssValue(vRawValues[i].data(), vRawValues[i].data() + vRawValues[i].size(), SER_DISK, CLIENT_VERSION);
+                V value;
+                ssValue >> value;
+                vFound.push_back(std::make_pair(vKeys[i], value));
+            } catch (const std::exception& e) {
+                LogPrintf("LevelDB batch read: failed to deserialize value of key %s: %s\n", HexStr(vRawKeys[i]), e.what());
+                fAllRead = false;
+            }
+        }
+        return fAllRead;
+    }
+
+    //! Raw form of ReadBatch(): vValues and vHave are filled in key order
+    void ReadRawBatch(const std::vector<std::string>& vKeys, std::vector<std::string>& vValues, std::vector<char>& vHave) const throw(leveldb_error);
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false) throw(leveldb_error)
     {
@@ -168,6 +266,9 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+    CLevelDBStatus GetStatus() const;
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -146,7 +146,7 @@ bool CoinSpend::HasValidSignature() const
     return pubkey.Verify(signatureHash(), vchSig);
 }
 
-CBigNum CoinSpend::CalculateValidSerial(ZerocoinParams* params)
+CBigNum CoinSpend::CalculateValidSerial(ZerocoinParams* params) const
 {
     CBigNum bnSerial = coinSerialNumber;
     bnSerial = bnSerial.mul_mod(CBigNum(1),params->coinCommitmentGroup.groupOrder);
@@ -120,7 +120,7 @@ public:
     bool Verify(const Accumulator& a) const;
     bool HasValidSerial(ZerocoinParams* params) const;
     bool HasValidSignature() const;
-    CBigNum CalculateValidSerial(ZerocoinParams* params);
+    CBigNum CalculateValidSerial(ZerocoinParams* params) const;
     std::string ToString() const;
 
     ADD_SERIALIZE_METHODS;
@@ -13,6 +13,8 @@
 #include "accumulators.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
+#include "blockfilter.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -23,8 +25,10 @@
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
+#include "messagedispatch.h"
 #include "net.h"
 #include "obfuscation.h"
+#include "obfuscation-sigcheck.h"
 #include "pow.h"
 #include "spork.h"
 #include "sporkdb.h"
@@ -41,6 +45,7 @@
 #include "libzerocoin/Denominations.h"
 #include "primitives/zerocoin.h"
 
+#include <numeric>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -76,6 +81,8 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fBlockFilterIndex = DEFAULT_BLOCKFILTERINDEX;
+bool fCompactBlocks = DEFAULT_COMPACT_BLOCKS;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -187,6 +194,9 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Change to the coin set statistics made by the blocks pcoinsTip holds unflushed. */
+CCoinsSetStats statsTipDelta;
 } // namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -235,6 +245,10 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Block announced by this peer as "cmpctblock" while we wait for its "blocktxn".
+    std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+    //! When the "blocktxn" for partialBlock was requested (in microseconds).
+    int64_t nPartialBlockTime;
 
     CNodeState()
     {
@@ -248,12 +262,16 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        nPartialBlockTime = 0;
     }
 };
 
 /** Map maintaining per-node state. Requires cs_main. */
 map<NodeId, CNodeState> mapNodeState;
 
+/** Peers asked to push new blocks as "cmpctblock" without announcing them first, oldest first. Requires cs_main. */
+list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
 // Requires cs_main.
 CNodeState* State(NodeId pnode)
 {
@@ -309,6 +327,7 @@ void FinalizeNode(NodeId nodeid)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -534,7 +553,10 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache* pcoinsTip = NULL;
 CBlockTreeDB* pblocktree = NULL;
+CCoinsViewWriteBehind* pcoinsWriteBehind = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
 CZerocoinDB* zerocoinDB = NULL;
+CBlockFilterDB* pblockfilterdb = NULL;
 CSporkDB* pSporkDB = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -923,10 +945,10 @@ bool MoneyRange(CAmount nValueOut)
     return nValueOut >= 0 && nValueOut <= Params().MaxMoneyOut();
 }
 
-bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly)
+bool CheckZerocoinMint(const CTransaction& tx, unsigned int nOut, CValidationState& state, bool fCheckOnly)
 {
     PublicCoin pubCoin(Params().Zerocoin_Params(false));
-    if (!TxOutToPublicCoin(txout, pubCoin, state))
+    if (!TxOutToPublicCoin(tx, nOut, pubCoin, state))
         return state.DoS(100, error("CheckZerocoinMint(): TxOutToPublicCoin() failed"));
 
     if (!pubCoin.validate())
@@ -1007,12 +1029,14 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     set<CBigNum> serials;
     list<CoinSpend> vSpends;
     CAmount nTotalRedeemed = 0;
-    for (const CTxIn& txin : tx.vin) {
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
         //only check txin that is a zcspend
+        const CTxIn& txin = tx.vin[nIn];
         if (!txin.scriptSig.IsZerocoinSpend())
             continue;
 
-        CoinSpend newSpend = TxInToZerocoinSpend(txin);
+        std::shared_ptr<const CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+        const CoinSpend& newSpend = *pspend;
         vSpends.push_back(newSpend);
 
         //check that the denomination is valid
@@ -1031,7 +1055,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
         if (fVerifySignature) {
             //see if we have record of the accumulator used in the spend tx
             CBigNum bnAccumulatorValue = 0;
-            if (!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue)) {
+            if (!ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue)) {
                 uint32_t nChecksum = newSpend.getAccumulatorChecksum();
                 return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
             }
@@ -1081,7 +1105,8 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
     // Check for negative or overflow output values
     CAmount nValueOut = 0;
     int nZCSpendCount = 0;
-    BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+    for (unsigned int nOut = 0; nOut < tx.vout.size(); nOut++) {
+        const CTxOut& txout = tx.vout[nOut];
         if (txout.IsEmpty() && !tx.IsCoinBase() && !tx.IsCoinStake())
             return state.DoS(100, error("CheckTransaction(): txout empty for user transaction"));
 
@@ -1096,7 +1121,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
             return state.DoS(100, error("CheckTransaction() : txout total out of range"),
                 REJECT_INVALID, "bad-txns-txouttotal-toolarge");
         if (fZerocoinActive && txout.IsZerocoinMint()) {
-            if (!CheckZerocoinMint(tx.GetHash(), txout, state, true))
+            if (!CheckZerocoinMint(tx, nOut, state, true))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin mint"));
         }
         if (fZerocoinActive && txout.scriptPubKey.IsZerocoinSpend())
@@ -1288,11 +1313,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                     REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
             //Check for double spending of serial #'s
-            for (const CTxIn& txIn : tx.vin) {
-                if (!txIn.scriptSig.IsZerocoinSpend())
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                if (!tx.vin[nIn].scriptSig.IsZerocoinSpend())
                     continue;
-                CoinSpend spend = TxInToZerocoinSpend(txIn);
-                if (!ContextualCheckZerocoinSpend(tx, spend, chainActive.Tip(), 0))
+                std::shared_ptr<const CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                if (!ContextualCheckZerocoinSpend(tx, *pspend, chainActive.Tip(), 0))
                     return state.Invalid(error("%s: ContextualCheckZerocoinSpend failed for tx %s", __func__,
                                              tx.GetHash().GetHex()),
                         REJECT_INVALID, "bad-txns-invalid-zpiv");
@@ -1326,12 +1351,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
             // Check that zZIJA mints are not already known
             if (tx.IsZerocoinMint()) {
-                for (auto& out : tx.vout) {
-                    if (!out.IsZerocoinMint())
+                for (unsigned int nOut = 0; nOut < tx.vout.size(); nOut++) {
+                    if (!tx.vout[nOut].IsZerocoinMint())
                         continue;
 
                     PublicCoin coin(Params().Zerocoin_Params(false));
-                    if (!TxOutToPublicCoin(out, coin, state))
+                    if (!TxOutToPublicCoin(tx, nOut, coin, state))
                         return state.Invalid(error("%s: failed final check of zerocoinmint for tx %s", __func__, tx.GetHash().GetHex()));
 
                     if (!ContextualCheckZerocoinMint(tx, coin, chainActive.Tip()))
@@ -1788,6 +1813,91 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    // The block is preceded by the message start and its size
+    CDiskBlockPos posHeader = pos;
+    if (posHeader.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+    posHeader.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : block magic mismatch at %d:%u", __func__, pos.nFile, pos.nPos);
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : invalid block size %u at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+        vchBlock.resize(nSize);
+        filein.read((char*)&vchBlock[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+CRawBlockCache rawBlockCache;
+
+CRawBlockCache::CRawBlockCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nBytes(0)
+{
+}
+
+void CRawBlockCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (nBytes > nMaxBytes && !listBlocks.empty()) {
+        nBytes -= listBlocks.back().second->size();
+        mapBlocks.erase(listBlocks.back().first);
+        listBlocks.pop_back();
+    }
+}
+
+CRawBlockCache::RawBlockRef CRawBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return RawBlockRef();
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+    return it->second->second;
+}
+
+void CRawBlockCache::Insert(const uint256& hash, const RawBlockRef& pblock)
+{
+    LOCK(cs);
+    if (mapBlocks.count(hash))
+        return;
+    listBlocks.push_front(std::make_pair(hash, pblock));
+    mapBlocks[hash] = listBlocks.begin();
+    nBytes += pblock->size();
+    Trim();
+}
+
+void CRawBlockCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+size_t CRawBlockCache::GetBytes() const
+{
+    LOCK(cs);
+    return nBytes;
+}
+
+size_t CRawBlockCache::GetCount() const
+{
+    LOCK(cs);
+    return listBlocks.size();
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2278,14 +2388,15 @@ map<COutPoint, COutPoint> mapInvalidOutPoints;
 map<CBigNum, CAmount> mapInvalidSerials;
 void AddInvalidSpendsToMap(const CBlock& block)
 {
-    for (const CTransaction tx : block.vtx) {
+    for (const CTransaction& tx : block.vtx) {
         if (!tx.ContainsZerocoins())
             continue;
 
         //Check all zerocoinspends for bad serials
-        for (const CTxIn in : tx.vin) {
-            if (in.scriptSig.IsZerocoinSpend()) {
-                CoinSpend spend = TxInToZerocoinSpend(in);
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+            if (tx.vin[nIn].scriptSig.IsZerocoinSpend()) {
+                std::shared_ptr<const CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                const CoinSpend& spend = *pspend;
 
                 //If serial is not valid, mark all outputs as bad
                 if (!spend.HasValidSerial(Params().Zerocoin_Params(false))) {
@@ -2443,7 +2554,49 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+namespace
+{
+/**
+ * Collects how a block changes the coin set statistics from the entries it
+ * touches. Their state before the block is taken from the view, which
+ * validation has already loaded them into, so this reads nothing from disk.
+ */
+class CCoinsSetStatsTracker
+{
+private:
+    const CCoinsViewCache& view;
+    std::map<uint256, CCoins> mapBefore;
+
+public:
+    CCoinsSetStatsTracker(const CCoinsViewCache& viewIn) : view(viewIn) {}
+
+    //! Remember the entry of txid before the block first changes it
+    void Touch(const uint256& txid)
+    {
+        if (mapBefore.count(txid))
+            return;
+        const CCoins* coins = view.AccessCoins(txid);
+        mapBefore[txid] = coins ? *coins : CCoins();
+    }
+
+    //! The block creates the entry of txid (BIP30: nothing unspent was there)
+    void TouchNew(const uint256& txid)
+    {
+        mapBefore.insert(std::make_pair(txid, CCoins()));
+    }
+
+    //! Add the change from the remembered entries to their current state
+    void Apply(CCoinsSetStats& stats) const
+    {
+        for (std::map<uint256, CCoins>::const_iterator it = mapBefore.begin(); it != mapBefore.end(); it++) {
+            const CCoins* coins = view.AccessCoins(it->first);
+            stats.Update(it->first, it->second, coins ? *coins : CCoins());
+        }
+    }
+};
+} // anonymous namespace
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CCoinsSetStats* pstatsDelta)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -2464,6 +2617,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    CCoinsSetStatsTracker trackerStats(view);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2475,9 +2630,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (tx.ContainsZerocoins()) {
             if (tx.IsZerocoinSpend()) {
                 //erase all zerocoinspends in this transaction
-                for (const CTxIn txin : tx.vin) {
-                    if (txin.scriptSig.IsZerocoinSpend()) {
-                        CoinSpend spend = TxInToZerocoinSpend(txin);
+                for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                    if (tx.vin[nIn].scriptSig.IsZerocoinSpend()) {
+                        std::shared_ptr<const CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                        const CoinSpend& spend = *pspend;
                         if (!zerocoinDB->EraseCoinSpend(spend.getCoinSerialNumber()))
                             return error("failed to erase spent zerocoin in block");
 
@@ -2494,12 +2650,13 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
             if (tx.IsZerocoinMint()) {
                 //erase all zerocoinmints in this transaction
-                for (const CTxOut txout : tx.vout) {
+                for (unsigned int nOut = 0; nOut < tx.vout.size(); nOut++) {
+                    const CTxOut& txout = tx.vout[nOut];
                     if (txout.scriptPubKey.empty() || !txout.scriptPubKey.IsZerocoinMint())
                         continue;
 
                     PublicCoin pubCoin(Params().Zerocoin_Params(false));
-                    if (!TxOutToPublicCoin(txout, pubCoin, state))
+                    if (!TxOutToPublicCoin(tx, nOut, pubCoin, state))
                         return error("DisconnectBlock(): TxOutToPublicCoin() failed");
 
                     if (!zerocoinDB->EraseCoinMint(pubCoin.getValue()))
@@ -2516,6 +2673,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         // specially with outsEmpty.
         {
             CCoins outsEmpty;
+            if (pstatsDelta)
+                trackerStats.Touch(hash);
             CCoinsModifier outs = view.ModifyCoins(hash);
             outs->ClearUnspendable();
 
@@ -2540,6 +2699,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
+                if (pstatsDelta)
+                    trackerStats.Touch(out.hash);
                 CCoinsModifier coins = view.ModifyCoins(out.hash);
                 if (undo.nHeight != 0) {
                     // undo data contains height: this is the last output of the prevout tx being spent
@@ -2562,6 +2723,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    if (pstatsDelta)
+        trackerStats.Apply(*pstatsDelta);
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2630,10 +2794,9 @@ void RecalculateZZIJAMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        pindex->nMintsInBlock.fill(0);
         for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->AddMint(mint.GetDenomination());
 
         if (pindex->nHeight < nHeightEnd)
             pindex = chainActive.Next(pindex);
@@ -2656,17 +2819,17 @@ void RecalculateZZIJASpent()
         list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->nZerocoinSupply = pindex->pprev->nZerocoinSupply;
 
         //Add mints to zZIJA supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            long nDenomAdded = pindex->GetMintCount(denom);
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) + nDenomAdded);
         }
 
         //Remove spends from zZIJA supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) - 1);
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2678,6 +2841,69 @@ void RecalculateZZIJASpent()
     }
 }
 
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s : block and undo data inconsistent", __func__);
+
+    stats.SetNull();
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+
+        // Zerocoin spends carry their denomination in nSequence and have no undo data
+        CAmount nTxValueIn = 0;
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
+                    nTxValueIn += tx.vin[j].nSequence * COIN;
+                    stats.nZerocoinSpent += tx.vin[j].nSequence * COIN;
+                } else if (j < txundo.vprevout.size()) {
+                    nTxValueIn += txundo.vprevout[j].txout.nValue;
+                }
+            }
+        }
+
+        CAmount nTxValueOut = 0;
+        for (const CTxOut& out : tx.vout) {
+            nTxValueOut += out.nValue;
+            if (out.IsZerocoinMint())
+                stats.nZerocoinMinted += out.nValue;
+        }
+
+        stats.nValueIn += nTxValueIn;
+        stats.nValueOut += nTxValueOut;
+        if (!tx.IsCoinBase() && !tx.IsCoinStake()) {
+            stats.nFees += nTxValueIn - nTxValueOut;
+            stats.nTxBytes += tx.GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
+            stats.nTxCount++;
+        }
+    }
+    return true;
+}
+
+bool GetBlockStats(const CBlockIndex* pindex, CBlockStats& stats)
+{
+    if (pblocktree->ReadBlockStats(pindex->GetBlockHash(), stats))
+        return true;
+
+    // Blocks connected before the statistics were recorded
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s : failed to read block %s", __func__, pindex->GetBlockHash().GetHex());
+    CBlockUndo blockundo;
+    if (pindex->pprev) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
+            return error("%s : failed to read undo data of block %s", __func__, pindex->GetBlockHash().GetHex());
+    }
+    if (!ComputeBlockStats(block, blockundo, stats))
+        return false;
+
+    pblocktree->WriteBlockStats(pindex->GetBlockHash(), stats);
+    return true;
+}
+
 bool RecalculateZIJASupply(int nHeightStart)
 {
     if (nHeightStart > chainActive.Height())
@@ -2692,38 +2918,11 @@ bool RecalculateZIJASupply(int nHeightStart)
         if (pindex->nHeight % 1000 == 0)
             LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
 
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
-
-                if (tx.vin[i].scriptSig.IsZerocoinSpend()) {
-                    nValueIn += tx.vin[i].nSequence * COIN;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[i].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                assert(GetTransaction(prevout.hash, txPrev, hashBlock, true));
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                if (i == 0 && tx.IsCoinStake())
-                    continue;
-
-                nValueOut += tx.vout[i].nValue;
-            }
-        }
+        CBlockStats stats;
+        assert(GetBlockStats(pindex, stats));
 
         // Rewrite money supply
-        pindex->nMoneySupply = nSupplyPrev + nValueOut - nValueIn;
+        pindex->nMoneySupply = nSupplyPrev + stats.nValueOut - stats.nValueIn;
         nSupplyPrev = pindex->nMoneySupply;
 
         // Add fraudulent funds to the supply and remove any recovered funds.
@@ -2807,20 +3006,18 @@ bool UpdateZZIJASupply(const CBlock& block, CBlockIndex* pindex)
 
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
-        for (auto& denom : zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->mapZerocoinSupply.at(denom);
-        }
+        pindex->nZerocoinSupply = pindex->pprev->nZerocoinSupply;
     }
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->nMintsInBlock.fill(0);
     if (pindex->pprev) {
         std::set<uint256> setAddedToWallet;
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->AddMint(denom);
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) + 1);
 
             //Remove any of our own mints from the mintpool
             if (pwalletMain) {
@@ -2845,17 +3042,17 @@ bool UpdateZZIJASupply(const CBlock& block, CBlockIndex* pindex)
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->SetZerocoinSupply(denom, pindex->GetZerocoinSupply(denom) - 1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
-            if (pindex->mapZerocoinSupply.at(denom) < 0)
+            if (pindex->GetZerocoinSupply(denom) < 0)
                 return error("Block contains zerocoins that spend more than are in the available supply to spend");
         }
     }
 
     for (auto& denom : zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->GetZerocoinSupply(denom));
 
     return true;
 }
@@ -2866,7 +3063,49 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+/**
+ * Batch-load the coins spent by the block, which ConnectBlock() would
+ * otherwise look up one key at a time.
+ */
+static void PrefetchBlockInputs(const CBlock& block, const CCoinsViewCache& view)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setBlockTx;
+    std::vector<uint256> vTxid;
+    for (const CTransaction& tx : block.vtx) {
+        setBlockTx.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+
+        for (const CTxIn& txin : tx.vin) {
+            // outputs created earlier in this block are not in any database yet
+            if (!txin.scriptSig.IsZerocoinSpend() && !setBlockTx.count(txin.prevout.hash))
+                vTxid.push_back(txin.prevout.hash);
+        }
+    }
+
+    view.PrefetchCoins(vTxid);
+
+    LogPrint("bench", "      - Prefetch %u inputs: %.2fms\n", (unsigned)vTxid.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+/** Build the basic filter of a block and store it with the filter header chained to its parent's */
+static bool WriteBlockFilterIndex(const CBlock& block, const CBlockIndex* pindex, CValidationState& state)
+{
+    if (!fBlockFilterIndex)
+        return true;
+
+    uint256 prevHeader;
+    if (pindex->pprev && !pblockfilterdb->ReadFilterHeader(pindex->pprev->GetBlockHash(), prevHeader))
+        return state.Abort("Failed to read block filter header of the previous block");
+
+    BlockFilter filter(BASIC_FILTER, block);
+    if (!pblockfilterdb->WriteFilter(filter, filter.ComputeHeader(prevHeader)))
+        return state.Abort("Failed to write block filter");
+    return true;
+}
+
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, CCoinsSetStats* pstatsDelta)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2882,6 +3121,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().HashGenesisBlock()) {
+        if (!fJustCheck && !WriteBlockFilterIndex(block, pindex, state))
+            return false;
         view.SetBestBlock(pindex->GetBlockHash());
         return true;
     }
@@ -2920,6 +3161,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
+    PrefetchBlockInputs(block, view);
+
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -2930,6 +3173,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<CoinSpend, uint256> > vSpends;
     std::vector<std::pair<PublicCoin, uint256> > vMints;
+    CCoinsSetStatsTracker trackerStats(view);
     vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -2964,10 +3208,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             //Check for double spending of serial #'s
             set<CBigNum> setSerials;
-            for (const CTxIn& txIn : tx.vin) {
-                if (!txIn.scriptSig.IsZerocoinSpend())
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                if (!tx.vin[nIn].scriptSig.IsZerocoinSpend())
                     continue;
-                CoinSpend spend = TxInToZerocoinSpend(txIn);
+                std::shared_ptr<const CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                const CoinSpend& spend = *pspend;
                 nValueIn += spend.getDenomination() * COIN;
 
                 //queue for db write after the 'justcheck' section has concluded
@@ -2978,12 +3223,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             // Check that zZIJA mints are not already known
             if (tx.IsZerocoinMint()) {
-                for (auto& out : tx.vout) {
-                    if (!out.IsZerocoinMint())
+                for (unsigned int nOut = 0; nOut < tx.vout.size(); nOut++) {
+                    if (!tx.vout[nOut].IsZerocoinMint())
                         continue;
 
                     PublicCoin coin(Params().Zerocoin_Params(false));
-                    if (!TxOutToPublicCoin(out, coin, state))
+                    if (!TxOutToPublicCoin(tx, nOut, coin, state))
                         return state.DoS(100, error("%s: failed final check of zerocoinmint for tx %s", __func__, tx.GetHash().GetHex()));
 
                     if (!ContextualCheckZerocoinMint(tx, coin, pindex))
@@ -3006,12 +3251,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             // Check that zZIJA mints are not already known
             if (tx.IsZerocoinMint()) {
-                for (auto& out : tx.vout) {
-                    if (!out.IsZerocoinMint())
+                for (unsigned int nOut = 0; nOut < tx.vout.size(); nOut++) {
+                    if (!tx.vout[nOut].IsZerocoinMint())
                         continue;
 
                     PublicCoin coin(Params().Zerocoin_Params(false));
-                    if (!TxOutToPublicCoin(out, coin, state))
+                    if (!TxOutToPublicCoin(tx, nOut, coin, state))
                         return state.DoS(100, error("%s: failed final check of zerocoinmint for tx %s", __func__, tx.GetHash().GetHex()));
 
                     if (!ContextualCheckZerocoinMint(tx, coin, pindex))
@@ -3040,6 +3285,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         nValueOut += tx.GetValueOut();
 
+        if (pstatsDelta) {
+            if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+                BOOST_FOREACH (const CTxIn& txin, tx.vin)
+                    trackerStats.Touch(txin.prevout.hash);
+            }
+            trackerStats.TouchNew(tx.GetHash());
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -3156,6 +3409,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (!WriteBlockFilterIndex(block, pindex, state))
+        return false;
+
+    CBlockStats stats;
+    if (!ComputeBlockStats(block, blockundo, stats) || !pblocktree->WriteBlockStats(pindex->GetBlockHash(), stats))
+        return state.Abort("Failed to write block statistics");
+
+    if (pstatsDelta)
+        trackerStats.Apply(*pstatsDelta);
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3214,32 +3477,48 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
-            // Then update all block file information (which may refer to block and undo files).
-            bool fileschanged = false;
+            // Then collect all block file information (which may refer to block and undo files)
+            // and the changed block index entries, to be written before the chainstate.
+            CBlockTreeUpdate update;
             for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end();) {
-                if (!pblocktree->WriteBlockFileInfo(*it, vinfoBlockFile[*it])) {
-                    return state.Abort("Failed to write to block index");
-                }
-                fileschanged = true;
+                update.vFileInfo.push_back(make_pair(*it, vinfoBlockFile[*it]));
                 setDirtyFileInfo.erase(it++);
             }
-            if (fileschanged && !pblocktree->WriteLastBlockFile(nLastBlockFile)) {
-                return state.Abort("Failed to write to block index");
-            }
+            if (!update.vFileInfo.empty())
+                update.nLastBlockFile = nLastBlockFile;
+            update.vBlockIndex.reserve(setDirtyBlockIndex.size());
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end();) {
-                if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(*it))) {
-                    return state.Abort("Failed to write to block index");
-                }
+                update.vBlockIndex.push_back(CDiskBlockIndex(*it));
                 setDirtyBlockIndex.erase(it++);
             }
-            pblocktree->Sync();
             // Finally flush the chainstate (which may refer to block index entries).
+            // With a background writer both are only handed over here, in that
+            // order, and validation continues while they are written; a full
+            // flush still waits until everything is on disk.
+            if (pcoinsWriteBehind) {
+                pcoinsWriteBehind->QueueBlockTreeUpdate(update);
+            } else if (!update.IsEmpty() && !pblocktree->WriteBlockTreeUpdate(update)) {
+                return state.Abort("Failed to write to block index");
+            }
+            if (pcoinsdbview)
+                pcoinsdbview->QueueStatsUpdate(pcoinsTip->GetBestBlock(), statsTipDelta);
+            statsTipDelta = CCoinsSetStats();
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
-            // Update best block in wallet (so we can detect restored wallets).
+            bool fAsync = pcoinsWriteBehind && mode != FLUSH_STATE_ALWAYS;
+            if (pcoinsWriteBehind && !fAsync && !pcoinsWriteBehind->WaitForWrites())
+                return state.Abort("Failed to write to coin database");
+            // Update best block in wallet (so we can detect restored wallets). Only
+            // report chain states that are known to be on disk: Flush() above waited
+            // for the previous background write to complete.
+            static CBlockLocator locatorWriting;
             if (mode != FLUSH_STATE_IF_NEEDED) {
-                GetMainSignals().SetBestChain(chainActive.GetLocator());
+                if (!fAsync)
+                    GetMainSignals().SetBestChain(chainActive.GetLocator());
+                else if (!locatorWriting.IsNull())
+                    GetMainSignals().SetBestChain(locatorWriting);
             }
+            locatorWriting = fAsync ? chainActive.GetLocator() : CBlockLocator();
             nLastWrite = GetTimeMicros();
         }
     } catch (const std::runtime_error& e) {
@@ -3309,9 +3588,11 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CCoinsSetStats statsDelta;
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, &statsDelta))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        statsTipDelta.Add(statsDelta);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -3371,7 +3652,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        CCoinsSetStats statsDelta;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, &statsDelta);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3383,6 +3665,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        statsTipDelta.Add(statsDelta);
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -3688,12 +3971,29 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
         if (!fInitialDownload) {
             uint256 hashNewTip = pindexNewTip->GetBlockHash();
             // Relay inventory, but don't relay old inventory during initial block download.
+            // Peers that asked for it get the block itself in compact form right away.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
+            CInv inv(MSG_BLOCK, hashNewTip);
+            std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+            if (fCompactBlocks && pblock && pblock->GetHash() == hashNewTip)
+                pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
             {
                 LOCK(cs_vNodes);
-                BOOST_FOREACH (CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                BOOST_FOREACH (CNode* pnode, vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    if (pcmpctblock && pnode->fPreferHeaderAndIDs) {
+                        {
+                            LOCK(pnode->cs_inventory);
+                            if (pnode->filterInventoryKnown.contains(inv.GetKey()))
+                                continue;
+                        }
+                        pnode->AddInventoryKnown(inv);
+                        pnode->PushMessage("cmpctblock", *pcmpctblock);
+                    } else {
+                        pnode->PushInventory(inv);
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
@@ -3819,19 +4119,13 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
         // ppcoin: compute stake entropy bit for stake modifier
         if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
+        // ppcoin: proof-of-stake hash values are kept in mapProofOfStake, not on the index entry
+        if (pindexNew->IsProofOfStake() && !mapProofOfStake.count(hash))
+            LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
 
         // ppcoin: compute stake modifier
         uint64_t nStakeModifier = 0;
@@ -4156,9 +4450,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
         // double check that there are no double spent zZIJA spends in this block
         if (tx.IsZerocoinSpend()) {
-            for (const CTxIn txIn : tx.vin) {
-                if (txIn.scriptSig.IsZerocoinSpend()) {
-                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                if (tx.vin[nIn].scriptSig.IsZerocoinSpend()) {
+                    std::shared_ptr<const libzerocoin::CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                    const libzerocoin::CoinSpend& spend = *pspend;
                     if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
                         return state.DoS(100, error("%s : Double spending of zZIJA serial %s in block\n Block: %s",
                                                   __func__, spend.getCoinSerialNumber().GetHex(), block.ToString()));
@@ -4736,16 +5031,19 @@ bool static LoadBlockIndexDB(string& strError)
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const PAIRTYPE(uint256, CBlockIndex*) & item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
+    // Calculate nChainWork, visiting the entries in height order. Heights
+    // are dense so a counting sort replaces sorting the whole index.
+    int nMaxHeight = 0;
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    vector<size_t> vHeightStart(nMaxHeight + 2, 0);
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vHeightStart[item.second->nHeight + 1]++;
+    std::partial_sum(vHeightStart.begin(), vHeightStart.end(), vHeightStart.begin());
+    vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const BlockMap::value_type& item : mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+    BOOST_FOREACH (CBlockIndex* pindex, vSortedByHeight) {
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
@@ -4816,6 +5114,10 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have a block filter index
+    pblocktree->ReadFlag("blockfilterindex", fBlockFilterIndex);
+    LogPrintf("LoadBlockIndexDB(): block filter index %s\n", fBlockFilterIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -4928,6 +5230,7 @@ void UnloadBlockIndex()
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
+    statsTipDelta = CCoinsSetStats();
 }
 
 bool LoadBlockIndex(string& strError)
@@ -4949,6 +5252,8 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    pblocktree->WriteFlag("blockfilterindex", fBlockFilterIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5291,8 +5596,11 @@ bool static AlreadyHave(const CInv& inv)
     }
     case MSG_DSTX:
         return mapObfuscationBroadcastTxes.count(inv.hash);
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash);
+    case MSG_BLOCK: {
+        // A header accepted from a compact block is not the block yet
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        return mi != mapBlockIndex.end() && (mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK));
+    }
     case MSG_TXLOCK_REQUEST:
         return mapTxLockReq.count(inv.hash) ||
                mapTxLockReqRejected.count(inv.hash);
@@ -5344,14 +5652,42 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+/**
+ * Ask the peer that just gave us a new tip to push its next blocks as
+ * "cmpctblock" without an "inv" round trip first, keeping the last
+ * MAX_HB_COMPACT_PEERS such peers. Requires cs_main.
+ */
+void static MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    AssertLockHeld(cs_main);
+    if (!fCompactBlocks || !pfrom->fSupportsCompactBlocks)
+        return;
+
+    list<NodeId>::iterator it = find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), pfrom->GetId());
+    if (it != lNodesAnnouncingHeaderAndIDs.end()) {
+        lNodesAnnouncingHeaderAndIDs.splice(lNodesAnnouncingHeaderAndIDs.end(), lNodesAnnouncingHeaderAndIDs, it);
+        return;
+    }
+
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_HB_COMPACT_PEERS) {
+        NodeId nodeEvict = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeEvict)
+                pnode->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
+        }
+    }
+    pfrom->PushMessage("sendcmpct", true, CMPCTBLOCKS_VERSION);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -5362,71 +5698,111 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end()) {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a max reorg depth than the best header
-                        // chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                               (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
-                        if (!send) {
-                            LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+                CDiskBlockPos posRaw;
+                {
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end()) {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a max reorg depth than the best header
+                            // chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                   (chainActive.Height() - mi->second->nHeight < Params().MaxReorganizationDepth());
+                            if (!send) {
+                                LogPrintf("ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // Don't send not-validated blocks
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter) {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage("merkleblock", merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didnt send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                    // Don't send not-validated blocks
+                    send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
+                    // Once the upload target is used up, historical blocks are left to other peers;
+                    // disconnect so the requester looks for them elsewhere instead of stalling on us
+                    if (send && !pfrom->fWhitelisted && CNode::OutboundTargetReached() &&
+                        mi->second->GetBlockTime() < GetAdjustedTime() - HISTORICAL_BLOCK_AGE) {
+                        LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+                        pfrom->fDisconnect = true;
+                        send = false;
+                    }
+                    if (send && inv.type == MSG_BLOCK) {
+                        // Full blocks go out as the bytes on disk, read once cs_main is released
+                        posRaw = mi->second->GetBlockPos();
+                    } else if (send) {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_CMPCT_BLOCK) {
+                            // Old blocks are rarely in the peer's mempool any more
+                            if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                                pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                            else
+                                pfrom->PushMessage("block", block);
+                        } else // MSG_FILTERED_BLOCK)
+                        {
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter) {
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                                pfrom->PushMessage("merkleblock", merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didnt send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH (PairType& pair, merkleBlock.vMatchedTxn) {
+                                    bool fKnown;
+                                    {
+                                        LOCK(pfrom->cs_inventory);
+                                        fKnown = pfrom->filterInventoryKnown.contains(CInv(MSG_TX, pair.second).GetKey());
+                                    }
+                                    if (!fKnown)
+                                        pfrom->PushMessage("tx", block.vtx[pair.first]);
+                                }
+                            }
+                            // else
+                            // no response
                         }
-                        // else
-                        // no response
                     }
+                }
 
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue) {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
+                if (!posRaw.IsNull()) {
+                    CRawBlockCache::RawBlockRef pblock = rawBlockCache.Get(inv.hash);
+                    if (!pblock) {
+                        std::shared_ptr<std::vector<unsigned char> > pblockRead(new std::vector<unsigned char>());
+                        if (!ReadRawBlockFromDisk(*pblockRead, posRaw))
+                            assert(!"cannot load block from disk");
+                        pblock = pblockRead;
+                        rawBlockCache.Insert(inv.hash, pblock);
                     }
+                    pfrom->PushMessage("block", CFlatData((void*)&(*pblock)[0], (void*)(&(*pblock)[0] + pblock->size())));
+                }
+
+                // Trigger them to send a getblocks request for the next batch of inventory
+                if (send && inv.hash == pfrom->hashContinue) {
+                    LOCK(cs_main);
+                    // Bypass PushInventory, this must send even if redundant,
+                    // and we want it right after the last block so they don't
+                    // wait for other stuff first.
+                    vector<CInv> vInv;
+                    vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                    pfrom->PushMessage("inv", vInv);
+                    pfrom->hashContinue = 0;
                 }
             } else if (inv.IsKnownType()) {
+                LOCK(cs_main);
                 // Send stream from relay memory
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSerializedNetMsgRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSerializedMessage((*mi).second);
                         pushed = true;
                     }
                 }
@@ -5577,6 +5953,136 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+/** Stop block of a block filter request if it is on the active chain and the filter type is served */
+static CBlockIndex* LookupBlockFilterStop(CNode* pfrom, uint8_t filterType, const uint256& hashStop)
+{
+    AssertLockHeld(cs_main);
+    if (!fBlockFilterIndex || filterType != BASIC_FILTER) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d, disconnecting\n", pfrom->id, filterType);
+        pfrom->fDisconnect = true;
+        return NULL;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+        LogPrint("net", "peer %d requested block filters up to unknown block %s\n", pfrom->id, hashStop.ToString());
+        return NULL;
+    }
+    return mi->second;
+}
+
+/**
+ * Check a getcfilters/getcfheaders request against the active chain and
+ * return the hashes of the blocks from nStartHeight up to hashStop and of
+ * the block before them (zero for the genesis block). Requests
+ * for a stop block we do not have on the active chain are ignored, they are
+ * normal around reorgs; malformed ones get the peer disconnected.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t filterType, uint32_t nStartHeight, const uint256& hashStop, int nMaxResults, std::vector<uint256>& vHash, uint256& hashPrevBlock)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexStop = LookupBlockFilterStop(pfrom, filterType, hashStop);
+    if (!pindexStop)
+        return false;
+    if (nStartHeight > (uint32_t)pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= (uint32_t)nMaxResults) {
+        Misbehaving(pfrom->GetId(), 100);
+        return error("%s : peer %d requested block filters of heights %u to %d", __func__, pfrom->id, nStartHeight, pindexStop->nHeight);
+    }
+
+    vHash.resize(pindexStop->nHeight - nStartHeight + 1);
+    CBlockIndex* pindex = pindexStop;
+    for (size_t i = vHash.size(); i > 0; i--) {
+        vHash[i - 1] = pindex->GetBlockHash();
+        pindex = pindex->pprev;
+    }
+    hashPrevBlock = pindex ? pindex->GetBlockHash() : uint256();
+    return true;
+}
+
+/** Check the header of a compact block, with the stake of a proof of stake block, and add it to
+ *  the block index the way AcceptBlock does before it stores a block. This runs before the mempool
+ *  is scanned for the block's transactions, so a made up header costs the sender valid work or stake.
+ *  Requires cs_main. */
+bool static AcceptCompactBlockHeader(const CBlockHeaderAndShortTxIDs& cmpctblock, CValidationState& state, CBlockIndex** ppindex)
+{
+    AssertLockHeld(cs_main);
+    CBlock block = cmpctblock.GetHeaderBlock();
+    uint256 hash = block.GetHash();
+
+    // A known header was checked when it was added, AcceptBlockHeader tells whether it failed since
+    if (!mapBlockIndex.count(hash)) {
+        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+            return state.DoS(0, error("%s : prev block %s not found", __func__, block.hashPrevBlock.ToString()), 0, "bad-prevblk");
+        CBlockIndex* pindexPrev = mi->second;
+        int nHeight = pindexPrev->nHeight + 1;
+
+        if (!CheckBlockHeader(block, state, block.IsProofOfWork()))
+            return false;
+        if (nHeight <= Params().LAST_POW_BLOCK() && block.IsProofOfStake())
+            return state.DoS(100, error("%s : PoS period not active", __func__), REJECT_INVALID, "PoS-early");
+        if (nHeight > Params().LAST_POW_BLOCK() && block.IsProofOfWork())
+            return state.DoS(100, error("%s : PoW period ended", __func__), REJECT_INVALID, "PoW-ended");
+        if (!CheckWork(block, pindexPrev))
+            return state.DoS(100, error("%s : incorrect difficulty", __func__), REJECT_INVALID, "bad-diffbits");
+
+        if (block.IsProofOfStake()) {
+            uint256 hashProofOfStake = 0;
+            unique_ptr<CStakeInput> stake;
+
+            if (!CheckProofOfStake(block, hashProofOfStake, stake))
+                return state.DoS(100, error("%s: proof of stake check failed", __func__));
+
+            if (!stake)
+                return error("%s: null stake ptr", __func__);
+
+            if (stake->IsZZIJA() && !ContextualCheckZerocoinStake(pindexPrev->nHeight, stake.get()))
+                return state.DoS(100, error("%s: staked zZIJA fails context checks", __func__));
+
+            if (!mapProofOfStake.count(hash))
+                mapProofOfStake.insert(make_pair(hash, hashProofOfStake));
+        }
+    }
+
+    return AcceptBlockHeader(block, state, ppindex);
+}
+
+/** Validate a block a peer sent in full or that was rebuilt from its compact form */
+void static ProcessBlockFromPeer(CNode* pfrom, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    bool fHaveData;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        fHaveData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+    }
+
+    CValidationState state;
+    if (!fHaveData) {
+        ProcessNewBlock(state, pfrom, &block);
+        int nDoS;
+        if (state.IsInvalid(nDoS)) {
+            pfrom->PushMessage("reject", string("block"), state.GetRejectCode(),
+                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+            if (nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        } else {
+            LOCK(cs_main);
+            if (chainActive.Tip()->GetBlockHash() == inv.hash)
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+        }
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(ActiveProtocol(), "block");
+    } else {
+        LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5717,6 +6223,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else if (strCommand == "verack") {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
+        // Tell the peer we understand compact blocks, it may then request them from us
+        if (fCompactBlocks && pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+            pfrom->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
+
         // Mark this node as currently connected, so we update its timestamp later.
         if (pfrom->fNetworkNode) {
             LOCK(cs_main);
@@ -5754,7 +6264,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 {
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                    // at a time so the addrKnown filters of the chosen nodes prevent repeats
                     static uint256 hashSalt;
                     if (hashSalt == 0)
                         hashSalt = GetRandHash();
@@ -5832,6 +6342,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        // A single new block from a compact block peer is most likely our next tip and
+        // mostly made of transactions we have, ask for it in compact form
+        if (vToFetch.size() == 1 && fCompactBlocks && pfrom->fSupportsCompactBlocks && !IsInitialBlockDownload() &&
+            !State(pfrom->GetId())->partialBlock)
+            vToFetch[0].type = MSG_CMPCT_BLOCK;
+
         if (!vToFetch.empty())
             pfrom->PushMessage("getdata", vToFetch);
     }
@@ -5927,6 +6443,76 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "getcfilters") {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> filterType >> nStartHeight >> hashStop;
+
+        std::vector<uint256> vHash;
+        uint256 hashPrevBlock;
+        if (!PrepareBlockFilterRequest(pfrom, filterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, vHash, hashPrevBlock))
+            return true;
+
+        // The filter database has its own lock, read without cs_main
+        for (const uint256& hashBlock : vHash) {
+            BlockFilter filter;
+            if (!pblockfilterdb->ReadFilter(hashBlock, filter))
+                return error("%s : cannot load block filter of %s", __func__, hashBlock.ToString());
+            pfrom->PushMessage("cfilter", filter.GetFilterType(), hashBlock, filter.GetEncodedFilter());
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders") {
+        uint8_t filterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> filterType >> nStartHeight >> hashStop;
+
+        std::vector<uint256> vHash;
+        uint256 hashPrevBlock;
+        if (!PrepareBlockFilterRequest(pfrom, filterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, vHash, hashPrevBlock))
+            return true;
+
+        // The client rebuilds the headers from the previous header and the filter hashes
+        uint256 prevHeader;
+        if (nStartHeight > 0 && !pblockfilterdb->ReadFilterHeader(hashPrevBlock, prevHeader))
+            return error("%s : cannot load block filter header of %s", __func__, hashPrevBlock.ToString());
+        std::vector<uint256> vFilterHash(vHash.size());
+        for (size_t i = 0; i < vHash.size(); i++) {
+            uint256 header;
+            if (!pblockfilterdb->ReadFilterHashAndHeader(vHash[i], vFilterHash[i], header))
+                return error("%s : cannot load block filter hash of %s", __func__, vHash[i].ToString());
+        }
+        pfrom->PushMessage("cfheaders", filterType, hashStop, prevHeader, vFilterHash);
+    }
+
+
+    else if (strCommand == "getcfcheckpt") {
+        uint8_t filterType;
+        uint256 hashStop;
+        vRecv >> filterType >> hashStop;
+
+        std::vector<uint256> vHash;
+        {
+            LOCK(cs_main);
+            CBlockIndex* pindexStop = LookupBlockFilterStop(pfrom, filterType, hashStop);
+            if (!pindexStop)
+                return true;
+            for (int nHeight = CFCHECKPT_INTERVAL; nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL)
+                vHash.push_back(pindexStop->GetAncestor(nHeight)->GetBlockHash());
+        }
+
+        std::vector<uint256> vHeader(vHash.size());
+        for (size_t i = 0; i < vHash.size(); i++) {
+            if (!pblockfilterdb->ReadFilterHeader(vHash[i], vHeader[i]))
+                return error("%s : cannot load block filter header of %s", __func__, vHash[i].ToString());
+        }
+        pfrom->PushMessage("cfcheckpt", filterType, hashStop, vHeader);
+    }
+
+
     else if (strCommand == "tx" || strCommand == "dstx") {
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
@@ -6145,6 +6731,152 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CheckBlockIndex();
     }
 
+    else if (strCommand == "sendcmpct") {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            pfrom->fSupportsCompactBlocks = true;
+            pfrom->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                return true;
+
+            // Without its parent the full block path works out where we are
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+                return true;
+            }
+
+            CValidationState state;
+            CBlockIndex* pindex = NULL;
+            if (!AcceptCompactBlockHeader(cmpctblock, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("%s : invalid cmpctblock header %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock());
+            ReadStatus status = partialBlock->InitData(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : invalid cmpctblock %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            req.blockhash = hashBlock;
+            for (size_t i = 0; i < partialBlock->GetTxCount(); i++) {
+                if (!partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (!req.indexes.empty()) {
+                State(pfrom->GetId())->partialBlock = partialBlock;
+                State(pfrom->GetId())->nPartialBlockTime = GetTimeMicros();
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            status = partialBlock->FillBlock(block, vector<CTransaction>());
+            if (status != READ_STATUS_OK) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+                return true;
+            }
+        }
+        ProcessBlockFromPeer(pfrom, block);
+    }
+
+
+    else if (strCommand == "getblocktxn") {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CBlockIndex* pindex = NULL;
+        bool fSendFull = false;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(mi->second)) {
+                LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+            pindex = mi->second;
+            // Too old to be rebuilt from a mempool, send it in full
+            fSendFull = pindex->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH;
+        }
+        if (fSendFull) {
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+            return true;
+        }
+
+        // Block index entries are never freed and block data never moves, read without cs_main
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return error("%s : cannot load block %s from disk", __func__, req.blockhash.ToString());
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : peer %d sent us a getblocktxn with out-of-bounds tx indices", __func__, pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock = nodestate->partialBlock;
+            if (!partialBlock || partialBlock->GetBlockHash() != resp.blockhash) {
+                LogPrint("net", "peer %d sent us blocktxn for a block we did not ask for\n", pfrom->id);
+                return true;
+            }
+            nodestate->partialBlock.reset();
+
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : invalid blocktxn %s from peer=%d", __func__, resp.blockhash.ToString(), pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Most likely a short id collision, fall back to the full block
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+                return true;
+            }
+        }
+        ProcessBlockFromPeer(pfrom, block);
+    }
+
+
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlock block;
@@ -6165,25 +6897,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 pfrom->vBlockRequested.push_back(hashBlock);
             }
         } else {
-            pfrom->AddInventoryKnown(inv);
-
-            CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if (nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
-            } else {
-                LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
-            }
+            ProcessBlockFromPeer(pfrom, block);
         }
     }
 
@@ -6438,6 +7152,39 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+bool ProcessReceivedMessage(CNode* pfrom, CNetMessage& msg)
+{
+    string strCommand = msg.hdr.GetCommand();
+    unsigned int nMessageSize = msg.hdr.nMessageSize;
+
+    bool fRet = false;
+    try {
+        fRet = ProcessMessage(pfrom, strCommand, msg.vRecv, msg.nTime);
+        boost::this_thread::interruption_point();
+    } catch (std::ios_base::failure& e) {
+        pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
+        if (strstr(e.what(), "end of data")) {
+            // Allow exceptions from under-length message on vRecv
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else if (strstr(e.what(), "size too large")) {
+            // Allow exceptions from over-long size
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    } catch (boost::thread_interrupted) {
+        throw;
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
+    if (!fRet)
+        LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
+    return fRet;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6460,6 +7207,33 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // Hand newly completed masternode, budget and SwiftX messages of peers
+    // that finished the handshake to the signature check workers, so their
+    // signatures are usually already verified by the time they are processed
+    // below. Messages already looked at form a prefix of the queue, so only
+    // the tail needs to be scanned.
+    if (!fLiteMode && pfrom->fSuccessfullyConnected && messageSigCheckQueue.IsActive()) {
+        std::deque<CNetMessage>::iterator itCheck = pfrom->vRecvMsg.end();
+        while (itCheck != pfrom->vRecvMsg.begin() && !(itCheck - 1)->fPrechecked)
+            --itCheck;
+        for (; itCheck != pfrom->vRecvMsg.end() && itCheck->complete(); ++itCheck) {
+            itCheck->fPrechecked = true;
+            const CMessageHeader& hdr = itCheck->hdr;
+            std::string strCommand = hdr.GetCommand();
+            if (!CMessageSigCheckQueue::IsSignedCommand(strCommand))
+                continue;
+            // Only messages that pass the checks below are worth a key recovery
+            if (memcmp(hdr.pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0 || !hdr.IsValid())
+                continue;
+            const CDataStream& vRecv = itCheck->vRecv;
+            uint256 hash = Hash(vRecv.begin(), vRecv.begin() + hdr.nMessageSize);
+            unsigned int nChecksum = 0;
+            memcpy(&nChecksum, &hash, sizeof(nChecksum));
+            if (nChecksum == hdr.nChecksum)
+                messageSigCheckQueue.Push(strCommand, vRecv, hash);
+        }
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -6510,32 +7284,13 @@ bool ProcessMessages(CNode* pfrom)
             continue;
         }
 
-        // Process message
-        bool fRet = false;
-        try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
-            boost::this_thread::interruption_point();
-        } catch (std::ios_base::failure& e) {
-            pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
-            if (strstr(e.what(), "end of data")) {
-                // Allow exceptions from under-length message on vRecv
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else if (strstr(e.what(), "size too large")) {
-                // Allow exceptions from over-long size
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else {
-                PrintExceptionContinue(&e, "ProcessMessages()");
-            }
-        } catch (boost::thread_interrupted) {
-            throw;
-        } catch (std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
-        }
+        // Masternode payment and budget sync requests are served by the dispatcher workers, off this thread
+        if (pfrom->fSuccessfullyConnected && CMessageDispatcher::IsDispatchedCommand(strCommand) &&
+            messageDispatcher.Push(pfrom, msg))
+            continue;
 
-        if (!fRet)
-            LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
+        // Process message
+        ProcessReceivedMessage(pfrom, msg);
 
         break;
     }
@@ -6548,7 +7303,11 @@ bool ProcessMessages(CNode* pfrom)
 }
 
 
-bool SendMessages(CNode* pto, bool fSendTrickle)
+//! Next trickle of transaction inventory to inbound peers, which share one timer so
+//! connecting many times does not reveal more about when transactions arrived here
+static int64_t nNextInvSendInbound = 0;
+
+bool SendMessages(CNode* pto)
 {
     {
         // Don't send anything until we get their version message
@@ -6585,34 +7344,41 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         }
 
         TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
-        if (!lockMain)
-            return true;
-
-        // Address refresh broadcast
-        static int64_t nLastRebroadcast;
-        if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                // Periodically clear setAddrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
-                    pnode->setAddrKnown.clear();
 
-                // Rebroadcast our address
-                AdvertizeLocal(pnode);
+        // A peer that is about to be banned gets nothing more
+        if (lockMain) {
+            CNodeState& state = *State(pto->GetId());
+            if (state.fShouldBan) {
+                if (pto->fWhitelisted)
+                    LogPrintf("Warning: not punishing whitelisted peer %s!\n", pto->addr.ToString());
+                else {
+                    pto->fDisconnect = true;
+                    if (pto->addr.IsLocal())
+                        LogPrintf("Warning: not banning local peer %s!\n", pto->addr.ToString());
+                    else {
+                        CNode::Ban(pto->addr, BanReasonNodeMisbehaving);
+                    }
+                }
+                state.fShouldBan = false;
             }
-            if (!vNodes.empty())
-                nLastRebroadcast = GetTime();
         }
+        if (pto->fDisconnect)
+            return true;
+
+        // Addresses and inventory only need the peer's own state, they go out on time
+        // even while cs_main is busy validating.
+        int64_t nNow = GetTimeMicros();
 
         //
         // Message: addr
         //
-        if (fSendTrickle) {
+        if (pto->nNextAddrSend < nNow) {
+            pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH (const CAddress& addr, pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
+                if (!pto->addrKnown.contains(addr.GetKey())) {
+                    pto->addrKnown.insert(addr.GetKey());
                     vAddr.push_back(addr);
                     // receiver rejects addr messages larger than 1000
                     if (vAddr.size() >= 1000) {
@@ -6626,21 +7392,82 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 pto->PushMessage("addr", vAddr);
         }
 
-        CNodeState& state = *State(pto->GetId());
-        if (state.fShouldBan) {
-            if (pto->fWhitelisted)
-                LogPrintf("Warning: not punishing whitelisted peer %s!\n", pto->addr.ToString());
-            else {
-                pto->fDisconnect = true;
-                if (pto->addr.IsLocal())
-                    LogPrintf("Warning: not banning local peer %s!\n", pto->addr.ToString());
-                else {
-                    CNode::Ban(pto->addr, BanReasonNodeMisbehaving);
+        //
+        // Message: inventory
+        //
+        // Transactions trickle out at Poisson distributed moments to protect privacy,
+        // whitelisted peers get them right away
+        bool fSendTrickle = pto->fWhitelisted;
+        if (pto->fInbound) {
+            // every inbound peer trickles once each time the shared timer moves on
+            if (nNextInvSendInbound < nNow)
+                nNextInvSendInbound = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL);
+            if (pto->nNextInvSend < nNextInvSendInbound) {
+                pto->nNextInvSend = nNextInvSendInbound;
+                fSendTrickle = true;
+            }
+        } else if (pto->nNextInvSend < nNow) {
+            pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> 1);
+            fSendTrickle = true;
+        }
+        vector<CInv> vInvQueued;
+        pto->queueInventoryToSend.TakeAll(vInvQueued);
+        if (!vInvQueued.empty() || (fSendTrickle && !pto->vInventoryTxToSend.empty())) {
+            vector<CInv> vInv;
+            {
+                LOCK(pto->cs_inventory);
+                BOOST_FOREACH (const CInv& inv, vInvQueued) {
+                    if (inv.type == MSG_TX) {
+                        pto->vInventoryTxToSend.push_back(inv);
+                        continue;
+                    }
+                    std::vector<unsigned char> vKey = inv.GetKey();
+                    if (!pto->filterInventoryKnown.contains(vKey)) {
+                        pto->filterInventoryKnown.insert(vKey);
+                        vInv.push_back(inv);
+                    }
                 }
+                if (fSendTrickle) {
+                    BOOST_FOREACH (const CInv& inv, pto->vInventoryTxToSend) {
+                        std::vector<unsigned char> vKey = inv.GetKey();
+                        if (!pto->filterInventoryKnown.contains(vKey)) {
+                            pto->filterInventoryKnown.insert(vKey);
+                            vInv.push_back(inv);
+                        }
+                    }
+                    pto->vInventoryTxToSend.clear();
+                }
+            }
+            // as few messages as the receiver's limit allows
+            for (size_t nStart = 0; nStart < vInv.size(); nStart += MAX_INV_SZ) {
+                size_t nEnd = std::min(vInv.size(), nStart + MAX_INV_SZ);
+                if (nStart == 0 && nEnd == vInv.size())
+                    pto->PushMessage("inv", vInv);
+                else
+                    pto->PushMessage("inv", vector<CInv>(vInv.begin() + nStart, vInv.begin() + nEnd));
             }
-            state.fShouldBan = false;
         }
 
+        if (!lockMain)
+            return true;
+
+        // Address refresh broadcast
+        static int64_t nLastRebroadcast;
+        if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH (CNode* pnode, vNodes) {
+                // Periodically clear addrKnown to allow refresh broadcasts
+                if (nLastRebroadcast)
+                    pnode->addrKnown.reset();
+
+                // Rebroadcast our address
+                AdvertizeLocal(pnode);
+            }
+            if (!vNodes.empty())
+                nLastRebroadcast = GetTime();
+        }
+
+        CNodeState& state = *State(pto->GetId());
         BOOST_FOREACH (const CBlockReject& reject, state.rejects)
             pto->PushMessage("reject", (string) "block", reject.chRejectCode, reject.strRejectReason, reject.hashBlock);
         state.rejects.clear();
@@ -6668,51 +7495,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             GetMainSignals().Broadcast();
         }
 
-        //
-        // Message: inventory
-        //
-        vector<CInv> vInv;
-        vector<CInv> vInvWait;
-        {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH (const CInv& inv, pto->vInventoryToSend) {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle) {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
-
-                    if (fTrickleWait) {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
-                }
-
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second) {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000) {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
-                }
-            }
-            pto->vInventoryToSend = vInvWait;
-        }
-        if (!vInv.empty())
-            pto->PushMessage("inv", vInv);
-
         // Detect whether we're stalling
-        int64_t nNow = GetTimeMicros();
+        nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
@@ -6734,6 +7518,15 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
+        // A compact block whose "blocktxn" did not come in time is fetched in full instead
+        if (state.partialBlock && state.nPartialBlockTime < nNow - 1000000 * BLOCKTXN_TIMEOUT) {
+            uint256 hashPartial = state.partialBlock->GetBlockHash();
+            state.partialBlock.reset();
+            LogPrint("net", "Timeout waiting for blocktxn of %s from peer=%d\n", hashPartial.ToString(), pto->id);
+            BlockMap::iterator mi = mapBlockIndex.find(hashPartial);
+            if (!pto->fDisconnect && (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)))
+                vGetData.push_back(CInv(MSG_BLOCK, hashPartial));
+        }
         if (!pto->fDisconnect && !pto->fClient && fFetch && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
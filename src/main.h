@@ -34,7 +34,9 @@
 
 #include <algorithm>
 #include <exception>
+#include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -47,7 +49,11 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsSetStats;
+class CCoinsViewDB;
+class CCoinsViewWriteBehind;
 class CZerocoinDB;
+class CBlockFilterDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -96,6 +102,11 @@ static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Average delay between trickled transaction inventory transmissions in seconds, halved for outbound peers.
+ *  Blocks and other inventory are sent on the next SendMessages run. */
+static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
+/** Average delay between peer address broadcasts in seconds. */
+static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached their tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -108,6 +119,10 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
+/** Default for -rawblockcache, MiB of serialized blocks kept to answer getdata requests */
+static const unsigned int DEFAULT_RAW_BLOCK_CACHE = 16;
+/** Default for -blockfilterindex, keep compact block filters for light clients */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
 
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
@@ -141,6 +156,8 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fBlockFilterIndex;
+extern bool fCompactBlocks;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -158,6 +175,8 @@ extern int64_t nReserveBalance;
 
 extern std::map<uint256, int64_t> mapRejectedBlocks;
 extern std::map<unsigned int, unsigned int> mapHashedBlocks;
+/** Proof-of-stake hash of the stake blocks checked this session, by block hash */
+extern std::map<uint256, uint256> mapProofOfStake;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern std::map<uint256, int64_t> mapZerocoinspends; //txid, time received
 
@@ -213,13 +232,14 @@ void UnloadBlockIndex();
 int ActiveProtocol();
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom);
+/** Process one complete message that passed the header and checksum checks */
+bool ProcessReceivedMessage(CNode* pfrom, CNetMessage& msg);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
  * @param[in]   pto             The node which we are sending messages to.
- * @param[in]   fSendTrickle    When true send the trickled data, otherwise trickle the data until true.
  */
-bool SendMessages(CNode* pto, bool fSendTrickle);
+bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
 
@@ -355,7 +375,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state);
-bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
+bool CheckZerocoinMint(const CTransaction& tx, unsigned int nOut, CValidationState& state, bool fCheckOnly = false);
 bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -402,6 +422,54 @@ public:
     bool ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock);
 };
 
+/** Value and fee totals of a connected block, stored in the block tree database */
+class CBlockStats
+{
+public:
+    CAmount nValueIn;        // value spent by all inputs, including zerocoin spends
+    CAmount nValueOut;       // value of all outputs
+    CAmount nZerocoinSpent;  // value of the zerocoin spends
+    CAmount nZerocoinMinted; // value of the zerocoin mints
+    CAmount nFees;           // fees of the transactions other than coinbase and coinstake
+    int64_t nTxBytes;        // serialized size of those transactions
+    unsigned int nTxCount;   // number of those transactions
+
+    CBlockStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nValueIn = 0;
+        nValueOut = 0;
+        nZerocoinSpent = 0;
+        nZerocoinMinted = 0;
+        nFees = 0;
+        nTxBytes = 0;
+        nTxCount = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nValueIn);
+        READWRITE(nValueOut);
+        READWRITE(nZerocoinSpent);
+        READWRITE(nZerocoinMinted);
+        READWRITE(nFees);
+        READWRITE(nTxBytes);
+        READWRITE(nTxCount);
+    }
+};
+
+/** Compute the statistics of a block from the block and its undo data */
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats);
+/** Read the statistics of a connected block, computing and storing them if they were never recorded */
+bool GetBlockStats(const CBlockIndex* pindex, CBlockStats& stats);
+
 
 /**
  * Closure representing one script verification
@@ -442,6 +510,40 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block as it is serialized on disk, which is also its network serialization */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos);
+
+/**
+ * Blocks recently sent to peers, as raw bytes. Peers in initial block download
+ * ask for the same blocks around the same time, this lets them share one read.
+ */
+class CRawBlockCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char> > RawBlockRef;
+
+private:
+    mutable CCriticalSection cs;
+    size_t nMaxBytes;
+    size_t nBytes;
+    //! most recently used first
+    std::list<std::pair<uint256, RawBlockRef> > listBlocks;
+    std::map<uint256, std::list<std::pair<uint256, RawBlockRef> >::iterator> mapBlocks;
+
+    void Trim();
+
+public:
+    explicit CRawBlockCache(size_t nMaxBytesIn = DEFAULT_RAW_BLOCK_CACHE << 20);
+
+    //! Returns an empty reference if the block is not cached, marks it as most recently used otherwise
+    RawBlockRef Get(const uint256& hash);
+    void Insert(const uint256& hash, const RawBlockRef& pblock);
+    void SetMaxBytes(size_t nMaxBytesIn);
+    size_t GetBytes() const;
+    size_t GetCount() const;
+};
+
+extern CRawBlockCache rawBlockCache;
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -449,14 +551,16 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. The change to the coin set
+ *  statistics is added to pstatsDelta if provided. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CCoinsSetStats* pstatsDelta = NULL);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
+ *  The change to the coin set statistics is added to pstatsDelta if provided. */
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false, CCoinsSetStats* pstatsDelta = NULL);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
@@ -633,9 +737,18 @@ extern CCoinsViewCache* pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
+/** Global variable that points to the background chainstate writer below pcoinsTip, if any (protected by cs_main) */
+extern CCoinsViewWriteBehind* pcoinsWriteBehind;
+
+/** Global variable that points to the coin database at the bottom of pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
 /** Global variable that points to the zerocoin database (protected by cs_main) */
 extern CZerocoinDB* zerocoinDB;
 
+/** Global variable that points to the block filter database, NULL unless -blockfilterindex is set (protected by cs_main) */
+extern CBlockFilterDB* pblockfilterdb;
+
 /** Global variable that points to the spork database (protected by cs_main) */
 extern CSporkDB* pSporkDB;
 
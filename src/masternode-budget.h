@@ -79,6 +79,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetStrMessage() const;
 
     std::string GetVoteString()
     {
@@ -131,6 +132,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -322,6 +324,10 @@ private:
     mutable CCriticalSection cs;
     bool fAutoChecked; //If it matches what we see, we'll auto vote for it (masternode only)
 
+protected:
+    // masternode list version the votes were last checked against (-1 = never)
+    int nVotesCheckedListVersion;
+
 public:
     bool fValid;
     std::string strBudgetName;
@@ -405,6 +411,8 @@ public:
         READWRITE(fAutoChecked);
 
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            nVotesCheckedListVersion = -1;
     }
 };
 
@@ -429,6 +437,7 @@ public:
         swap(first.strBudgetName, second.strBudgetName);
         swap(first.nBlockStart, second.nBlockStart);
         first.mapVotes.swap(second.mapVotes);
+        swap(first.nVotesCheckedListVersion, second.nVotesCheckedListVersion);
         first.vecBudgetPayments.swap(second.vecBudgetPayments);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         swap(first.nTime, second.nTime);
@@ -468,6 +477,20 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+protected:
+    // running tallies of mapVotes, kept current by AddOrUpdateVote and CleanAndRemove
+    int nYeas;
+    int nNays;
+    int nAbstains;
+    // GetRatio() counts votes regardless of their validity
+    int nAllYeas;
+    int nAllNays;
+    // masternode list version the votes were last checked against (-1 = never)
+    int nVotesCheckedListVersion;
+
+    void CountVote(const CBudgetVote& vote, int nDelta);
+    void RecountVotes();
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -518,9 +541,9 @@ public:
     int GetBlockCurrentCycle();
     int GetBlockEndCycle();
     double GetRatio();
-    int GetYeas();
-    int GetNays();
-    int GetAbstains();
+    int GetYeas() { return nYeas; }
+    int GetNays() { return nNays; }
+    int GetAbstains() { return nAbstains; }
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
@@ -559,6 +582,10 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead()) {
+            RecountVotes();
+            nVotesCheckedListVersion = -1;
+        }
     }
 };
 
@@ -587,6 +614,12 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        swap(first.nYeas, second.nYeas);
+        swap(first.nNays, second.nNays);
+        swap(first.nAbstains, second.nAbstains);
+        swap(first.nAllYeas, second.nAllYeas);
+        swap(first.nAllNays, second.nAllNays);
+        swap(first.nVotesCheckedListVersion, second.nVotesCheckedListVersion);
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -481,13 +481,17 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom,
 	}
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const {
+	return vinMasternode.prevout.ToStringShort()
+			+ boost::lexical_cast<std::string>(nBlockHeight) + payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode,
 		CPubKey& pubKeyMasternode) {
 	std::string errorMessage;
 	std::string strMasterNodeSignMessage;
 
-	std::string strMessage = vinMasternode.prevout.ToStringShort()
-			+ boost::lexical_cast<std::string>(nBlockHeight) + payee.ToString();
+	std::string strMessage = GetStrMessage();
 
 	if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig,
 			keyMasternode)) {
@@ -852,9 +856,7 @@ bool CMasternodePaymentWinner::SignatureValid() {
 	CMasternode* pmn = mnodeman.Find(vinMasternode);
 
 	if (pmn != NULL) {
-		std::string strMessage = vinMasternode.prevout.ToStringShort()
-				+ boost::lexical_cast<std::string>(nBlockHeight)
-				+ payee.ToString();
+		std::string strMessage = GetStrMessage();
 
 		std::string errorMessage = "";
 		if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig,
@@ -67,6 +67,8 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // bumped whenever a Masternode is added to or removed from vMasternodes
+    int nListVersion;
 
 public:
     // Keep track of all broadcasts I've seen
@@ -84,6 +86,8 @@ public:
     {
         LOCK(cs);
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            nListVersion++;
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -148,6 +152,13 @@ public:
     /// Return the number of (unique) Masternodes
     int size() { return vMasternodes.size(); }
 
+    /// Changes whenever the set of known Masternodes changes
+    int GetListVersion()
+    {
+        LOCK(cs);
+        return nListVersion;
+    }
+
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
 
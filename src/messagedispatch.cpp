@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagedispatch.h"
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+CMessageDispatcher messageDispatcher;
+
+bool CMessageDispatcher::IsDispatchedCommand(const std::string& strCommand)
+{
+    // Only the list sync requests: they read the payment votes and budget items under
+    // cs_mapMasternodePayeeVotes and cs_budget, which the handlers adding to those maps hold too.
+    // Announcements, votes and "ssc" add to the seen maps that getdata and AlreadyHave read
+    // on the message handler thread without a lock, so they stay there, as do SwiftX and sporks.
+    return strCommand == "mnget" || strCommand == "mnvs";
+}
+
+bool CMessageDispatcher::Push(CNode* pnode, const CNetMessage& msg)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (nThreads == 0)
+        return false;
+
+    {
+        LOCK(pnode->cs_vDispatchMsg);
+        pnode->vDispatchMsg.push_back(msg);
+        pnode->nDispatchMsgSize += msg.vRecv.size() + 24;
+        // A worker already has the peer and picks the message up after the ones before it
+        if (pnode->fDispatchQueued)
+            return true;
+        pnode->fDispatchQueued = true;
+    }
+
+    // Keep the peer around until a worker is done with it
+    {
+        LOCK(cs_vNodes);
+        pnode->AddRef();
+    }
+    queueNodes.push_back(pnode);
+    lock.unlock();
+    condWorker.notify_one();
+    return true;
+}
+
+bool CMessageDispatcher::IsActive()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nThreads > 0;
+}
+
+bool CMessageDispatcher::ProcessNode(CNode* pnode)
+{
+    std::deque<CNetMessage> vMsg;
+    {
+        LOCK(pnode->cs_vDispatchMsg);
+        while (!pnode->vDispatchMsg.empty() && vMsg.size() < MSGDISPATCH_BATCH_SIZE) {
+            pnode->nDispatchMsgSize -= pnode->vDispatchMsg.front().vRecv.size() + 24;
+            vMsg.push_back(pnode->vDispatchMsg.front());
+            pnode->vDispatchMsg.pop_front();
+        }
+    }
+
+    for (unsigned int i = 0; i < vMsg.size() && !pnode->fDisconnect; i++)
+        ProcessReceivedMessage(pnode, vMsg[i]);
+
+    LOCK(pnode->cs_vDispatchMsg);
+    if (!pnode->vDispatchMsg.empty())
+        return true;
+    pnode->fDispatchQueued = false;
+    return false;
+}
+
+void CMessageDispatcher::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads++;
+    }
+
+    try {
+        while (true) {
+            CNode* pnode;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queueNodes.empty())
+                    condWorker.wait(lock);
+                pnode = queueNodes.front();
+                queueNodes.pop_front();
+            }
+
+            if (ProcessNode(pnode)) {
+                // Back of the queue, so a busy peer does not hold up the others
+                boost::unique_lock<boost::mutex> lock(mutex);
+                queueNodes.push_back(pnode);
+            } else {
+                LOCK(cs_vNodes);
+                pnode->Release();
+            }
+            boost::this_thread::interruption_point();
+        }
+    } catch (boost::thread_interrupted&) {
+        std::deque<CNode*> queueRelease;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nThreads--;
+            if (nThreads == 0)
+                queueRelease.swap(queueNodes);
+        }
+        {
+            LOCK(cs_vNodes);
+            for (CNode* pnode : queueRelease)
+                pnode->Release();
+        }
+        throw;
+    }
+}
+
+void ThreadMessageDispatch()
+{
+    RenameThread("zija-msgdisp");
+    messageDispatcher.Thread();
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MESSAGEDISPATCH_H
+#define MESSAGEDISPATCH_H
+
+#include <deque>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CMessageDispatcher;
+class CNetMessage;
+class CNode;
+
+// default number of threads serving masternode payment and budget sync requests (0 = message handler thread)
+#define DEFAULT_MSGDISPATCH_THREADS 1
+#define MAX_MSGDISPATCH_THREADS 4
+// messages of one peer processed before a worker moves on to the next peer
+#define MSGDISPATCH_BATCH_SIZE 16
+
+extern CMessageDispatcher messageDispatcher;
+
+/** Hands the masternode payment and budget sync requests from the message
+ *  handler thread to worker threads, so serving a peer the full vote and
+ *  budget lists happens under the locks of their managers instead of
+ *  queueing behind block and transaction validation.
+ *  A peer is given to one worker at a time: messages of a peer are
+ *  processed in the order they were received, relative to each other.
+ *  They are no longer ordered relative to the peer's other messages,
+ *  which is why only commands that do not depend on those are dispatched.
+ */
+class CMessageDispatcher
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    //! peers with dispatched messages that no worker is processing yet
+    std::deque<CNode*> queueNodes;
+    int nThreads;
+
+    //! Process up to MSGDISPATCH_BATCH_SIZE messages of pnode, returns whether more are waiting
+    bool ProcessNode(CNode* pnode);
+
+public:
+    CMessageDispatcher() : nThreads(0) {}
+
+    //! Whether messages of this type are processed by the workers
+    static bool IsDispatchedCommand(const std::string& strCommand);
+
+    //! Queue a copy of a complete message of pnode, returns false if there are no workers to process it
+    bool Push(CNode* pnode, const CNetMessage& msg);
+
+    bool IsActive();
+
+    //! Worker thread loop
+    void Thread();
+};
+
+void ThreadMessageDispatch();
+
+#endif
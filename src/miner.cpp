@@ -357,9 +357,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
                     continue;
 
                 bool fDoubleSerial = false;
-                for (const CTxIn txIn : tx.vin) {
-                    if (txIn.scriptSig.IsZerocoinSpend()) {
-                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+                for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                    if (tx.vin[nIn].scriptSig.IsZerocoinSpend()) {
+                        std::shared_ptr<const libzerocoin::CoinSpend> pspend = TxInToZerocoinSpend(tx, nIn);
+                        const libzerocoin::CoinSpend& spend = *pspend;
                         bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend.getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
                         if (!spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
                             fDoubleSerial = true;
@@ -672,8 +673,7 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             LogPrintf("CPUMiner : proof-of-stake block found %s \n", pblock->GetHash().ToString().c_str());
             if (pblock->IsZerocoinStake()) {
                 //Find the key associated with the zerocoin that is being staked
-                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(pblock->vtx[1].vin[0]);
-                CBigNum bnSerial = spend.getCoinSerialNumber();
+                CBigNum bnSerial = TxInToZerocoinSpend(pblock->vtx[1], 0)->getCoinSerialNumber();
                 CKey key;
                 if (!pwallet->GetZerocoinKey(bnSerial, key)) {
                     LogPrintf("%s: failed to find zZIJA with serial %s, unable to sign block\n", __func__, bnSerial.GetHex());
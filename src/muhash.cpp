@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+
+namespace
+{
+const unsigned int MUHASH_BYTES = 384;
+
+const CBigNum& MuHashModulus()
+{
+    // 2^3072 - 1103717, the largest 3072-bit safe prime
+    static const CBigNum bnModulus = CBigNum(2).pow(3072) - CBigNum(1103717);
+    return bnModulus;
+}
+
+/** Expand arbitrary data to a uniformly distributed element mod the MuHash prime */
+CBigNum DataToNum3072(const std::vector<unsigned char>& vData)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(vData.empty() ? NULL : &vData[0], vData.size()).Finalize(seed);
+
+    // One trailing zero byte keeps the little-endian MPI positive
+    std::vector<unsigned char> vch(MUHASH_BYTES + 1, 0);
+    for (unsigned char i = 0; i < MUHASH_BYTES / CSHA256::OUTPUT_SIZE; i++)
+        CSHA256().Write(seed, sizeof(seed)).Write(&i, 1).Finalize(&vch[i * CSHA256::OUTPUT_SIZE]);
+
+    CBigNum bn;
+    bn.setvch(vch);
+    return bn % MuHashModulus();
+}
+} // anonymous namespace
+
+CMuHash3072::CMuHash3072() : numerator(1), denominator(1)
+{
+}
+
+void CMuHash3072::Insert(const std::vector<unsigned char>& vData)
+{
+    numerator = numerator.mul_mod(DataToNum3072(vData), MuHashModulus());
+}
+
+void CMuHash3072::Remove(const std::vector<unsigned char>& vData)
+{
+    denominator = denominator.mul_mod(DataToNum3072(vData), MuHashModulus());
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& other)
+{
+    numerator = numerator.mul_mod(other.numerator, MuHashModulus());
+    denominator = denominator.mul_mod(other.denominator, MuHashModulus());
+    return *this;
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    CBigNum bnResult = numerator.mul_mod(denominator.inverse(MuHashModulus()), MuHashModulus());
+    std::vector<unsigned char> vch = bnResult.getvch();
+    vch.resize(MUHASH_BYTES, 0);
+    return Hash(vch.begin(), vch.end());
+}
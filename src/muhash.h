@@ -0,0 +1,51 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/**
+ * Order-independent hash of a multiset of byte strings.
+ *
+ * Every element is expanded to a number modulo the prime 2^3072 - 1103717
+ * and multiplied into a running numerator (Insert) or denominator (Remove).
+ * Inserting and later removing the same element cancels out, so the set
+ * hash can be updated incrementally instead of being recomputed from
+ * scratch. The division is only carried out by Finalize().
+ */
+class CMuHash3072
+{
+private:
+    CBigNum numerator;
+    CBigNum denominator;
+
+public:
+    CMuHash3072();
+
+    void Insert(const std::vector<unsigned char>& vData);
+    void Remove(const std::vector<unsigned char>& vData);
+
+    /** Combine with another set hash (union of both multisets) */
+    CMuHash3072& operator*=(const CMuHash3072& other);
+
+    /** Compute the 256-bit digest of the current set */
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_MUHASH_H
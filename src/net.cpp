@@ -23,6 +23,8 @@
 #include "ui_interface.h"
 #include "wallet.h"
 
+#include <math.h>
+
 #ifdef WIN32
 #include <string.h>
 #else
@@ -90,8 +92,10 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
+map<CInv, CSerializedNetMsgRef> mapRelay;
+deque<CInv> vRelayExpiration;
+size_t nRelayCacheSize = 0;
+size_t nMaxRelayCacheSize = DEFAULT_RELAY_CACHE << 20;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -339,10 +343,13 @@ void AddressCurrentlyConnected(const CService& addr)
 }
 
 
-uint64_t CNode::nTotalBytesRecv = 0;
-uint64_t CNode::nTotalBytesSent = 0;
-CCriticalSection CNode::cs_totalBytesRecv;
-CCriticalSection CNode::cs_totalBytesSent;
+std::atomic<uint64_t> CNode::nTotalBytesRecv(0);
+std::atomic<uint64_t> CNode::nTotalBytesSent(0);
+CNetMessageCounters CNode::totalSentPerMsgType;
+CNetMessageCounters CNode::totalRecvPerMsgType;
+std::atomic<uint64_t> CNode::nMaxOutboundLimit(0);
+std::atomic<int64_t> CNode::nMaxOutboundCycleStartTime(0);
+std::atomic<uint64_t> CNode::nMaxOutboundCycleStartBytes(0);
 
 CNode* FindNode(const CNetAddr& ip)
 {
@@ -685,6 +692,8 @@ void CNode::copyStats(CNodeStats& stats)
     X(nSendBytes);
     X(nRecvBytes);
     X(fWhitelisted);
+    sentPerMsgType.GetTraffic(stats.mapSendPerMsgType);
+    recvPerMsgType.GetTraffic(stats.mapRecvPerMsgType);
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -737,6 +746,9 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
+            unsigned int nType = GetNetMessageTypeIndex(msg.hdr.GetCommand());
+            recvPerMsgType.Record(nType, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
+            totalRecvPerMsgType.Record(nType, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
             messageHandlerCondition.notify_one();
         }
     }
@@ -794,10 +806,10 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializedNetMsgRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        const CSerializeData& data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -1510,10 +1522,6 @@ void ThreadMessageHandler()
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-
         bool fSleep = true;
 
         BOOST_FOREACH (CNode* pnode, vNodesCopy) {
@@ -1540,7 +1548,7 @@ void ThreadMessageHandler()
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                    g_signals.SendMessages(pnode);
             }
             boost::this_thread::interruption_point();
         }
@@ -1845,21 +1853,29 @@ void RelayTransaction(const CTransaction& tx)
     RelayTransaction(tx, ss);
 }
 
+/** Keep a message to answer getdata requests for inv with, dropping the oldest ones beyond -relaycache */
+static void AddToRelayCache(const CInv& inv, const CSerializedNetMsgRef& msg)
+{
+    LOCK(cs_mapRelay);
+    if (!mapRelay.insert(std::make_pair(inv, msg)).second)
+        return;
+    vRelayExpiration.push_back(inv);
+    nRelayCacheSize += msg->size();
+
+    while (nRelayCacheSize > nMaxRelayCacheSize && !vRelayExpiration.empty()) {
+        map<CInv, CSerializedNetMsgRef>::iterator mi = mapRelay.find(vRelayExpiration.front());
+        nRelayCacheSize -= mi->second->size();
+        mapRelay.erase(mi);
+        vRelayExpiration.pop_front();
+    }
+}
+
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime()) {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
+    // Save original serialized message so newer versions are preserved
+    AddToRelayCache(inv, MakeNetMessage("tx", ss));
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
     LOCK(cs_vNodes);
     BOOST_FOREACH (CNode* pnode, vNodes) {
         if (!pnode->fRelayTxes)
@@ -1877,13 +1893,20 @@ void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
 {
     CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
 
+    // Serialized once for all peers, and kept for the ones asking for it later
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(1000);
+    ss << tx;
+    CSerializedNetMsgRef msg = MakeNetMessage("ix", ss);
+    AddToRelayCache(inv, msg);
+
     //broadcast the new lock
     LOCK(cs_vNodes);
     BOOST_FOREACH (CNode* pnode, vNodes) {
         if (!relayToAll && !pnode->fRelayTxes)
             continue;
 
-        pnode->PushMessage("ix", tx);
+        pnode->PushSerializedMessage(msg);
     }
 }
 
@@ -1897,28 +1920,144 @@ void RelayInv(CInv& inv)
     }
 }
 
+CInvQueue::~CInvQueue()
+{
+    Entry* pentry = phead.load();
+    while (pentry) {
+        Entry* pnext = pentry->pnext;
+        delete pentry;
+        pentry = pnext;
+    }
+}
+
+void CInvQueue::TakeAll(std::vector<CInv>& vInv)
+{
+    Entry* pentry = phead.exchange(NULL, std::memory_order_acquire);
+    // the list runs newest to oldest, fill the new part of vInv from the back
+    size_t nCount = 0;
+    for (Entry* p = pentry; p; p = p->pnext)
+        nCount++;
+    size_t nPos = vInv.size() + nCount;
+    vInv.resize(nPos);
+    while (pentry) {
+        vInv[--nPos] = pentry->inv;
+        Entry* pnext = pentry->pnext;
+        delete pentry;
+        pentry = pnext;
+    }
+}
+
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds)
+{
+    return nNow + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
+}
+
+CNetMessageCounters::CNetMessageCounters()
+{
+    for (unsigned int i = 0; i <= NET_MESSAGE_TYPE_COUNT; i++) {
+        vBytes[i] = 0;
+        vMessages[i] = 0;
+    }
+}
+
+void CNetMessageCounters::GetTraffic(msgtypetraffic_t& mapTraffic) const
+{
+    for (unsigned int i = 0; i <= NET_MESSAGE_TYPE_COUNT; i++) {
+        uint64_t nMessages = vMessages[i].load(std::memory_order_relaxed);
+        if (nMessages == 0)
+            continue;
+        mapTraffic[GetNetMessageTypeName(i)] = std::make_pair(vBytes[i].load(std::memory_order_relaxed), nMessages);
+    }
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
-    LOCK(cs_totalBytesRecv);
-    nTotalBytesRecv += bytes;
+    nTotalBytesRecv.fetch_add(bytes, std::memory_order_relaxed);
 }
 
 void CNode::RecordBytesSent(uint64_t bytes)
 {
-    LOCK(cs_totalBytesSent);
-    nTotalBytesSent += bytes;
+    uint64_t nTotal = nTotalBytesSent.fetch_add(bytes) + bytes;
+    if (nMaxOutboundLimit.load() == 0)
+        return;
+
+    // Start a new upload cycle once the current one is over; the thread winning the exchange
+    // moves the base, and these bytes are the first ones of the new cycle
+    int64_t nNow = GetTime();
+    int64_t nCycleStart = nMaxOutboundCycleStartTime.load();
+    if (nCycleStart + MAX_UPLOAD_TIMEFRAME < nNow && nMaxOutboundCycleStartTime.compare_exchange_strong(nCycleStart, nNow))
+        nMaxOutboundCycleStartBytes = nTotal - bytes;
+}
+
+void CNode::RecordMessageSent(const CSerializeData& msg)
+{
+    assert(msg.size() >= CMessageHeader::HEADER_SIZE);
+    const char* pszCommand = &msg[MESSAGE_START_SIZE];
+    unsigned int nType = GetNetMessageTypeIndex(std::string(pszCommand, strnlen(pszCommand, CMessageHeader::COMMAND_SIZE)));
+    sentPerMsgType.Record(nType, msg.size());
+    totalSentPerMsgType.Record(nType, msg.size());
 }
 
 uint64_t CNode::GetTotalBytesRecv()
 {
-    LOCK(cs_totalBytesRecv);
-    return nTotalBytesRecv;
+    return nTotalBytesRecv.load();
 }
 
 uint64_t CNode::GetTotalBytesSent()
 {
-    LOCK(cs_totalBytesSent);
-    return nTotalBytesSent;
+    return nTotalBytesSent.load();
+}
+
+void CNode::GetTotalTraffic(msgtypetraffic_t& mapSent, msgtypetraffic_t& mapRecv)
+{
+    totalSentPerMsgType.GetTraffic(mapSent);
+    totalRecvPerMsgType.GetTraffic(mapRecv);
+}
+
+void CNode::SetMaxOutboundTarget(uint64_t nLimit)
+{
+    nMaxOutboundCycleStartBytes = nTotalBytesSent.load();
+    nMaxOutboundCycleStartTime = GetTime();
+    nMaxOutboundLimit = nLimit;
+}
+
+uint64_t CNode::GetMaxOutboundTarget()
+{
+    return nMaxOutboundLimit.load();
+}
+
+uint64_t CNode::GetOutboundBytesSentInCycle()
+{
+    // a cycle nothing was sent in since it ended has not been rolled over yet
+    if (nMaxOutboundCycleStartTime.load() + MAX_UPLOAD_TIMEFRAME < GetTime())
+        return 0;
+    uint64_t nTotal = nTotalBytesSent.load();
+    uint64_t nCycleStartBytes = nMaxOutboundCycleStartBytes.load();
+    return nTotal > nCycleStartBytes ? nTotal - nCycleStartBytes : 0;
+}
+
+bool CNode::OutboundTargetReached()
+{
+    uint64_t nLimit = nMaxOutboundLimit.load();
+    return nLimit != 0 && GetOutboundBytesSentInCycle() >= nLimit;
+}
+
+uint64_t CNode::GetOutboundTargetBytesLeft()
+{
+    uint64_t nLimit = nMaxOutboundLimit.load();
+    if (nLimit == 0)
+        return 0;
+    uint64_t nSent = GetOutboundBytesSentInCycle();
+    return nSent >= nLimit ? 0 : nLimit - nSent;
+}
+
+int64_t CNode::GetMaxOutboundTimeLeftInCycle()
+{
+    if (nMaxOutboundLimit.load() == 0)
+        return 0;
+    int64_t nCycleEnd = nMaxOutboundCycleStartTime.load() + MAX_UPLOAD_TIMEFRAME;
+    int64_t nNow = GetTime();
+    return nCycleEnd < nNow ? MAX_UPLOAD_TIMEFRAME : nCycleEnd - nNow;
 }
 
 void CNode::Fuzz(int nChance)
@@ -1971,29 +2110,32 @@ bool CAddrDB::Write(const CAddrMan& addr)
     GetRandBytes((unsigned char*)&randv, sizeof(randv));
     std::string tmpfn = strprintf("peers.dat.%04x", randv);
 
-    // serialize addresses, checksum data up to that point, then append csum
-    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
-    ssPeers << FLATDATA(Params().MessageStart());
-    ssPeers << addr;
-    uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
-    ssPeers << hash;
-
-    // open output file, and associate with CAutoFile
-    boost::filesystem::path pathAddr = GetDataDir() / "peers.dat";
-    FILE* file = fopen(pathAddr.string().c_str(), "wb");
+    // open temporary output file, and associate with CAutoFile; peers.dat is
+    // only replaced once it is complete, as it is now written while serializing
+    boost::filesystem::path pathTmp = GetDataDir() / tmpfn;
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
     CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathAddr.string());
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
 
-    // Write and commit header, data
+    // serialize addresses straight to the file, checksum data up to that point, then append csum
     try {
-        fileout << ssPeers;
+        CHashForwarder<CAutoFile> hashout(&fileout);
+        hashout << FLATDATA(Params().MessageStart());
+        hashout << addr;
+        fileout << hashout.GetHash();
     } catch (std::exception& e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
         return error("%s : Serialize or I/O error - %s", __func__, e.what());
     }
     FileCommit(fileout.Get());
     fileout.fclose();
 
+    // replace existing peers.dat, if any, with new peers.dat.XXXX
+    if (!RenameOver(pathTmp, pathAddr))
+        return error("%s : Rename-into-place failed", __func__);
+
     return true;
 }
 
@@ -2005,44 +2147,31 @@ bool CAddrDB::Read(CAddrMan& addr)
     if (filein.IsNull())
         return error("%s : Failed to open file %s", __func__, pathAddr.string());
 
-    // use file size to size memory buffer
-    uint64_t fileSize = boost::filesystem::file_size(pathAddr);
-    uint64_t dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (fileSize >= sizeof(uint256))
-        dataSize = fileSize - sizeof(uint256);
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-    }
-    filein.fclose();
-
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssPeers.begin(), ssPeers.end());
-    if (hashIn != hashTmp)
-        return error("%s : Checksum mismatch, data corrupted", __func__);
-
+    // de-serialize straight from the file, hashing what is read to verify the checksum behind it
     unsigned char pchMsgTmp[4];
     try {
+        CHashVerifier<CAutoFile> hashin(&filein);
+
         // de-serialize file header (network specific magic number) and ..
-        ssPeers >> FLATDATA(pchMsgTmp);
+        hashin >> FLATDATA(pchMsgTmp);
 
         // ... verify the network matches ours
         if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
             return error("%s : Invalid network magic number", __func__);
 
         // de-serialize address data into one CAddrMan object
-        ssPeers >> addr;
+        hashin >> addr;
+
+        // verify stored checksum matches input data
+        uint256 hashIn;
+        filein >> hashIn;
+        if (hashIn != hashin.GetHash()) {
+            addr.Clear();
+            return error("%s : Checksum mismatch, data corrupted", __func__);
+        }
     } catch (std::exception& e) {
+        // do not leave a partially loaded addrman behind
+        addr.Clear();
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
@@ -2052,7 +2181,9 @@ bool CAddrDB::Read(CAddrMan& addr)
 unsigned int ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000); }
 unsigned int SendBufferSize() { return 1000 * GetArg("-maxsendbuffer", 1 * 1000); }
 
-CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
+CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION),
+                                                                                                   addrKnown(ADDR_KNOWN_FILTER_SIZE, ADDR_KNOWN_FILTER_FPRATE),
+                                                                                                   filterInventoryKnown(INVENTORY_KNOWN_FILTER_SIZE, INVENTORY_KNOWN_FILTER_FPRATE)
 {
     nServices = 0;
     hSocket = hSocketIn;
@@ -2079,9 +2210,14 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nSendOffset = 0;
     hashContinue = 0;
     nStartingHeight = -1;
+    nNextInvSend = 0;
+    nNextAddrSend = 0;
     fGetAddr = false;
     fRelayTxes = false;
-    setInventoryKnown.max_size(SendBufferSize() / 1000);
+    fSupportsCompactBlocks = false;
+    fPreferHeaderAndIDs = false;
+    nDispatchMsgSize = 0;
+    fDispatchQueued = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
@@ -2194,17 +2330,50 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ssSend.GetAndClear(*pdata);
+    RecordMessageSent(*pdata);
+    nSendSize += pdata->size();
+    vSendMsg.push_back(pdata);
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSerializedMessage(const CSerializedNetMsgRef& msg)
+{
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", SanitizeString(std::string(&(*msg)[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE)),
+        msg->size() - CMessageHeader::HEADER_SIZE, id);
+    RecordMessageSent(*msg);
+    vSendMsg.push_back(msg);
+    nSendSize += msg->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
+CSerializedNetMsgRef MakeNetMessage(const char* pszCommand, const CDataStream& payload)
+{
+    CMessageHeader hdr(pszCommand, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + payload.size());
+    ss << hdr;
+    if (!payload.empty())
+        ss.write(&payload[0], payload.size());
+
+    std::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ss.GetAndClear(*pdata);
+    return pdata;
+}
+
 //
 // CBanDB
 //
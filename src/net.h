@@ -13,7 +13,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -22,7 +21,10 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
+#include <map>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -51,6 +53,12 @@ static const int TIMEOUT_INTERVAL = 20 * 60;
 static const unsigned int MAX_INV_SZ = 50000;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** Number of recent addresses remembered as known to a peer, and the false positive rate doing so */
+static const unsigned int ADDR_KNOWN_FILTER_SIZE = 5000;
+static const double ADDR_KNOWN_FILTER_FPRATE = 0.001;
+/** Number of recent inventory items remembered as known to a peer; a false positive withholds an announcement */
+static const unsigned int INVENTORY_KNOWN_FILTER_SIZE = 5000;
+static const double INVENTORY_KNOWN_FILTER_FPRATE = 0.000001;
 /** Maximum length of incoming protocol messages (no message over 2 MiB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
 /** -listen default */
@@ -61,9 +69,23 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** Default for -relaycache, MiB of serialized transaction messages kept to answer getdata requests */
+static const unsigned int DEFAULT_RELAY_CACHE = 10;
+/** The default for -maxuploadtarget, in MiB per day. 0 = no limit */
+static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
+/** The period over which -maxuploadtarget is measured */
+static const int64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
+/** Blocks older than this are no longer served once the upload target is reached */
+static const int64_t HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
+/** Complete serialized network message, shared read-only by the send queues of all peers it goes to */
+typedef std::shared_ptr<const CSerializeData> CSerializedNetMsgRef;
+
+/** Build a message with header and checksum once, to be queued to any number of peers with PushSerializedMessage */
+CSerializedNetMsgRef MakeNetMessage(const char* pszCommand, const CDataStream& payload);
+
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
@@ -79,6 +101,8 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
+/** Return a timestamp in the future (in microseconds) for exponentially distributed events. */
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds);
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
@@ -89,7 +113,7 @@ typedef int NodeId;
 struct CNodeSignals {
     boost::signals2::signal<int()> GetHeight;
     boost::signals2::signal<bool(CNode*)> ProcessMessages;
-    boost::signals2::signal<bool(CNode*, bool)> SendMessages;
+    boost::signals2::signal<bool(CNode*)> SendMessages;
     boost::signals2::signal<void(NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void(NodeId)> FinalizeNode;
 };
@@ -133,8 +157,11 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+extern std::map<CInv, CSerializedNetMsgRef> mapRelay;
+//! mapRelay entries oldest first, dropped once the cache exceeds nMaxRelayCacheSize bytes
+extern std::deque<CInv> vRelayExpiration;
+extern size_t nRelayCacheSize;
+extern size_t nMaxRelayCacheSize;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
@@ -152,6 +179,70 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Inventory queued for a peer from any thread, taken out by the message handler thread.
+ *  Producers push onto the head of a linked list with a compare-and-swap; the consumer
+ *  swaps out the whole list at once, so entries are never removed one by one and no
+ *  lock is needed on either side.
+ */
+class CInvQueue
+{
+private:
+    struct Entry {
+        CInv inv;
+        Entry* pnext;
+    };
+    std::atomic<Entry*> phead;
+
+    CInvQueue(const CInvQueue&);
+    void operator=(const CInvQueue&);
+
+public:
+    CInvQueue() : phead(NULL) {}
+    ~CInvQueue();
+
+    void Push(const CInv& inv)
+    {
+        Entry* pentry = new Entry;
+        pentry->inv = inv;
+        pentry->pnext = phead.load(std::memory_order_relaxed);
+        while (!phead.compare_exchange_weak(pentry->pnext, pentry, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    //! Move everything queued so far to the end of vInv, oldest first
+    void TakeAll(std::vector<CInv>& vInv);
+};
+
+/** Bytes and messages of one message type, keyed by message type name */
+typedef std::map<std::string, std::pair<uint64_t, uint64_t> > msgtypetraffic_t;
+
+/** Byte and message counters per message type, for one direction of traffic.
+ *  Counters are updated without taking a lock; a reader sees each counter
+ *  up to date on its own, not a snapshot of all of them at one moment.
+ */
+class CNetMessageCounters
+{
+private:
+    std::atomic<uint64_t> vBytes[NET_MESSAGE_TYPE_COUNT + 1];
+    std::atomic<uint64_t> vMessages[NET_MESSAGE_TYPE_COUNT + 1];
+
+    CNetMessageCounters(const CNetMessageCounters&);
+    void operator=(const CNetMessageCounters&);
+
+public:
+    CNetMessageCounters();
+
+    //! Count one message of nBytes (header included) of the message type with index nType
+    void Record(unsigned int nType, uint64_t nBytes)
+    {
+        vBytes[nType].fetch_add(nBytes, std::memory_order_relaxed);
+        vMessages[nType].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! Add the message types seen so far to mapTraffic
+    void GetTraffic(msgtypetraffic_t& mapTraffic) const;
+};
+
 class CNodeStats
 {
 public:
@@ -167,7 +258,9 @@ public:
     bool fInbound;
     int nStartingHeight;
     uint64_t nSendBytes;
+    msgtypetraffic_t mapSendPerMsgType;
     uint64_t nRecvBytes;
+    msgtypetraffic_t mapRecvPerMsgType;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -189,6 +282,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fPrechecked; // already handed to the message signature check workers
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -196,6 +291,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fPrechecked = false;
     }
 
     bool complete() const
@@ -289,14 +385,22 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsgRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Complete messages waiting for a CMessageDispatcher worker, in the order received
+    CCriticalSection cs_vDispatchMsg;
+    std::deque<CNetMessage> vDispatchMsg;
+    size_t nDispatchMsgSize;
+    bool fDispatchQueued; // handed to the workers, which queue the peer itself only once
     uint64_t nRecvBytes;
     int nRecvVersion;
+    // Traffic per message type; sent messages are counted when queued, received ones when complete
+    CNetMessageCounters sentPerMsgType;
+    CNetMessageCounters recvPerMsgType;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -323,6 +427,10 @@ public:
     // b) the peer may tell us in their version message that we should not relay tx invs
     //    until they have initialized their bloom filter.
     bool fRelayTxes;
+    // Peer sent "sendcmpct": we may ask it for blocks as MSG_CMPCT_BLOCK
+    bool fSupportsCompactBlocks;
+    // Peer wants new blocks pushed as "cmpctblock" right away instead of announced by "inv"
+    bool fPreferHeaderAndIDs;
     // Should be 'true' only if we connected to this node to actually mix funds.
     // In this case node will be released automatically via CMasternodeMan::ProcessMasternodeConnections().
     // Connecting to verify connectability/status or connecting for sending/relaying single message
@@ -358,13 +466,17 @@ public:
 
     // flood relay
     std::vector<CAddress> vAddrToSend;
-    mruset<CAddress> setAddrKnown;
+    CRollingBloomFilter addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
-    std::vector<CInv> vInventoryToSend;
+    CRollingBloomFilter filterInventoryKnown;
+    CInvQueue queueInventoryToSend;
+    // Transaction inventory waiting for the next trickle, message handler thread only
+    std::vector<CInv> vInventoryTxToSend;
+    int64_t nNextInvSend;
+    int64_t nNextAddrSend;
     CCriticalSection cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
     std::vector<uint256> vBlockRequested;
@@ -384,10 +496,19 @@ public:
 
 private:
     // Network usage totals
-    static CCriticalSection cs_totalBytesRecv;
-    static CCriticalSection cs_totalBytesSent;
-    static uint64_t nTotalBytesRecv;
-    static uint64_t nTotalBytesSent;
+    static std::atomic<uint64_t> nTotalBytesRecv;
+    static std::atomic<uint64_t> nTotalBytesSent;
+    static CNetMessageCounters totalSentPerMsgType;
+    static CNetMessageCounters totalRecvPerMsgType;
+
+    // Outbound limit (-maxuploadtarget), in bytes per MAX_UPLOAD_TIMEFRAME, 0 = no limit
+    static std::atomic<uint64_t> nMaxOutboundLimit;
+    // Start of the current upload cycle, and nTotalBytesSent at that moment
+    static std::atomic<int64_t> nMaxOutboundCycleStartTime;
+    static std::atomic<uint64_t> nMaxOutboundCycleStartBytes;
+
+    //! Count a message queued for sending
+    void RecordMessageSent(const CSerializeData& msg);
 
     CNode(const CNode&);
     void operator=(const CNode&);
@@ -410,7 +531,8 @@ public:
         unsigned int total = 0;
         BOOST_FOREACH (const CNetMessage& msg, vRecvMsg)
             total += msg.vRecv.size() + 24;
-        return total;
+        LOCK(cs_vDispatchMsg);
+        return total + nDispatchMsgSize;
     }
 
     // requires LOCK(cs_vRecvMsg)
@@ -438,7 +560,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
@@ -446,7 +568,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
-        if (addr.IsValid() && !setAddrKnown.count(addr)) {
+        if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
             } else {
@@ -460,17 +582,14 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.GetKey());
         }
     }
 
     void PushInventory(const CInv& inv)
     {
-        {
-            LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
-                vInventoryToSend.push_back(inv);
-        }
+        // Known inventory is filtered out by SendMessages
+        queueInventoryToSend.Push(inv);
     }
 
     void AskFor(const CInv& inv);
@@ -484,6 +603,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    //! Queue a message built by MakeNetMessage without copying or re-serializing it
+    void PushSerializedMessage(const CSerializedNetMsgRef& msg);
+
     void PushVersion();
 
 
@@ -728,6 +850,23 @@ public:
 
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
+    static void GetTotalTraffic(msgtypetraffic_t& mapSent, msgtypetraffic_t& mapRecv);
+
+    //! Set the upload target, in bytes per MAX_UPLOAD_TIMEFRAME (0 = no limit)
+    static void SetMaxOutboundTarget(uint64_t nLimit);
+    static uint64_t GetMaxOutboundTarget();
+
+    //! Bytes sent in the current upload cycle
+    static uint64_t GetOutboundBytesSentInCycle();
+
+    //! Whether the upload target of the current cycle is used up
+    static bool OutboundTargetReached();
+
+    //! Bytes left of the upload target in the current cycle, 0 if there is no target
+    static uint64_t GetOutboundTargetBytesLeft();
+
+    //! Seconds left in the current upload cycle, 0 if there is no target
+    static int64_t GetMaxOutboundTimeLeftInCycle();
 };
 
 class CExplicitNetCleanup
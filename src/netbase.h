@@ -87,6 +87,7 @@ public:
     std::string ToStringIP() const;
     unsigned int GetByte(int n) const;
     uint64_t GetHash() const;
+    uint64_t GetSaltedHash(uint64_t k0, uint64_t k1) const; // keyed SipHash of the IP, for hash tables of addresses
     bool GetInAddr(struct in_addr* pipv4Addr) const;
     std::vector<unsigned char> GetGroup() const;
     int GetReachabilityFrom(const CNetAddr* paddrPartner = NULL) const;
@@ -0,0 +1,136 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "obfuscation-sigcheck.h"
+
+#include "masternode.h"
+#include "masternode-budget.h"
+#include "masternode-payments.h"
+#include "obfuscation.h"
+#include "swifttx.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+CMessageSigCheckQueue messageSigCheckQueue;
+
+bool CMessageSigCheckQueue::IsSignedCommand(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw" ||
+           strCommand == "mvote" || strCommand == "fbvote" || strCommand == "txlvote";
+}
+
+bool CMessageSigCheckQueue::Push(const std::string& strCommand, const CDataStream& vRecv, const uint256& hashPayload)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nThreads == 0 || queue.size() >= MAX_MSGSIGCHECK_QUEUE)
+            return false;
+        std::vector<unsigned char> vKey(hashPayload.begin(), hashPayload.end());
+        if (filterQueued->contains(vKey))
+            return false;
+        filterQueued->insert(vKey);
+        queue.push_back(std::make_pair(strCommand, vRecv));
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+bool CMessageSigCheckQueue::IsActive()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nThreads > 0;
+}
+
+size_t CMessageSigCheckQueue::size()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+void CMessageSigCheckQueue::Check(const std::string& strCommand, CDataStream& vRecv)
+{
+    CKeyID keyID;
+
+    if (strCommand == "mnb") {
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+        // Older masternodes still sign the legacy message format
+        if (!obfuScationSigner.RecoverMessageSigner(mnb.sig, mnb.GetNewStrMessage(), keyID) ||
+            keyID != mnb.pubKeyCollateralAddress.GetID())
+            obfuScationSigner.RecoverMessageSigner(mnb.sig, mnb.GetOldStrMessage(), keyID);
+        obfuScationSigner.RecoverMessageSigner(mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage(), keyID);
+    } else if (strCommand == "mnp") {
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        obfuScationSigner.RecoverMessageSigner(mnp.vchSig, mnp.GetStrMessage(), keyID);
+    } else if (strCommand == "mnw") {
+        CMasternodePaymentWinner winner;
+        vRecv >> winner;
+        obfuScationSigner.RecoverMessageSigner(winner.vchSig, winner.GetStrMessage(), keyID);
+    } else if (strCommand == "mvote") {
+        CBudgetVote vote;
+        vRecv >> vote;
+        obfuScationSigner.RecoverMessageSigner(vote.vchSig, vote.GetStrMessage(), keyID);
+    } else if (strCommand == "fbvote") {
+        CFinalizedBudgetVote vote;
+        vRecv >> vote;
+        obfuScationSigner.RecoverMessageSigner(vote.vchSig, vote.GetStrMessage(), keyID);
+    } else if (strCommand == "txlvote") {
+        CConsensusVote vote;
+        vRecv >> vote;
+        obfuScationSigner.RecoverMessageSigner(vote.vchMasterNodeSignature, vote.GetStrMessage(), keyID);
+    }
+}
+
+void CMessageSigCheckQueue::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads++;
+        // Created here rather than at static initialization, it draws random hash keys
+        if (!filterQueued)
+            filterQueued.reset(new CRollingBloomFilter(MAX_MSGSIGCHECK_QUEUE, 0.000001));
+    }
+
+    std::vector<std::pair<std::string, CDataStream> > vBatch;
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty())
+                    condWorker.wait(lock);
+                while (!queue.empty() && vBatch.size() < MSGSIGCHECK_BATCH_SIZE) {
+                    vBatch.push_back(queue.front());
+                    queue.pop_front();
+                }
+            }
+
+            for (unsigned int i = 0; i < vBatch.size(); i++) {
+                try {
+                    Check(vBatch[i].first, vBatch[i].second);
+                } catch (std::exception& e) {
+                    // Malformed messages are rejected by the message handler
+                    LogPrint("masternode", "CMessageSigCheckQueue::Thread - %s: %s\n", SanitizeString(vBatch[i].first), e.what());
+                }
+            }
+            vBatch.clear();
+            boost::this_thread::interruption_point();
+        }
+    } catch (boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads--;
+        if (nThreads == 0)
+            queue.clear();
+        throw;
+    }
+}
+
+void ThreadMessageSigCheck()
+{
+    RenameThread("zija-msgsigch");
+    messageSigCheckQueue.Thread();
+}
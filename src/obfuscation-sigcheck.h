@@ -0,0 +1,70 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef OBFUSCATION_SIGCHECK_H
+#define OBFUSCATION_SIGCHECK_H
+
+#include "bloom.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CMessageSigCheckQueue;
+
+// default number of threads pre-verifying masternode/budget/SwiftX message signatures (0 = disabled)
+#define DEFAULT_MSGSIGCHECK_THREADS 2
+#define MAX_MSGSIGCHECK_THREADS 8
+// messages waiting for pre-verification above this are left to the message handler
+#define MAX_MSGSIGCHECK_QUEUE 20000
+// messages taken off the queue by a worker at once
+#define MSGSIGCHECK_BATCH_SIZE 64
+
+extern CMessageSigCheckQueue messageSigCheckQueue;
+
+/** Queue of received network messages whose signatures are recovered ahead of
+ *  time by worker threads. The recovered signers land in the verified-message
+ *  cache of CObfuScationSigner, so when the message handler gets to the
+ *  message, VerifyMessage is a cache lookup instead of a key recovery.
+ *  Pre-verification never changes the outcome of message processing: a
+ *  message that was not (yet) checked is simply verified by the handler.
+ */
+class CMessageSigCheckQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    std::deque<std::pair<std::string, CDataStream> > queue;
+    //! Payload hashes of recently queued messages, the same message arrives from many peers
+    std::unique_ptr<CRollingBloomFilter> filterQueued;
+    int nThreads;
+
+    void Check(const std::string& strCommand, CDataStream& vRecv);
+
+public:
+    CMessageSigCheckQueue() : nThreads(0) {}
+
+    //! Whether messages of this type carry a masternode signature worth checking ahead
+    static bool IsSignedCommand(const std::string& strCommand);
+
+    //! Queue a copy of the message with payload hash hashPayload for pre-verification,
+    //! returns false if it was dropped or an identical one was queued recently
+    bool Push(const std::string& strCommand, const CDataStream& vRecv, const uint256& hashPayload);
+
+    bool IsActive();
+    size_t size();
+
+    //! Worker thread loop
+    void Thread();
+};
+
+void ThreadMessageSigCheck();
+
+#endif
@@ -7,9 +7,12 @@
 
 #include "obfuscation.h"
 #include "coincontrol.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "main.h"
 #include "masternodeman.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -18,6 +21,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
 #include <algorithm>
 #include <boost/assign/list_of.hpp>
@@ -2164,22 +2168,114 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+namespace
+{
+/**
+ * Cache of successfully verified (message hash, signature, signer) triples.
+ * The same masternode, budget and SwiftX messages arrive from many peers, and
+ * the message check workers verify them before the message handler does, so
+ * this saves most of the compact signature recoveries.
+ */
+class CMessageSigCache
+{
+private:
+    //! Entries are SHA256(nonce || message hash || signer key id || signature):
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    bool fSetup;
+    boost::shared_mutex cs_msgsigcache;
+
+    void ComputeEntry(uint256& entry, const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hashMessage.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+public:
+    CMessageSigCache() : fSetup(false) {}
+
+    //! Until this is called every lookup misses and nothing is stored
+    void Setup()
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        if (fSetup)
+            return;
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(MESSAGE_SIG_CACHE_BYTES);
+        fSetup = true;
+    }
+
+    bool Get(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        if (!fSetup)
+            return false;
+        uint256 entry;
+        ComputeEntry(entry, hashMessage, vchSig, keyID);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        if (!fSetup)
+            return;
+        uint256 entry;
+        ComputeEntry(entry, hashMessage, vchSig, keyID);
+        setValid.insert(entry);
+    }
+};
+
+CMessageSigCache messageSigCache;
+
+uint256 GetSignedMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
+}
+
+void InitMessageSigCache()
+{
+    messageSigCache.Setup();
+    LogPrintf("Using %u MiB for the masternode message signature cache\n", MESSAGE_SIG_CACHE_BYTES >> 20);
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    uint256 hashMessage = GetSignedMessageHash(strMessage);
+
+    if (messageSigCache.Get(hashMessage, vchSig, pubkey.GetID()))
+        return true;
 
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!pubkey2.RecoverCompact(hashMessage, vchSig)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (pubkey2.GetID() != pubkey.GetID()) {
+        if (fDebug)
+            LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+        return false;
+    }
+
+    messageSigCache.Set(hashMessage, vchSig, pubkey2.GetID());
+    return true;
+}
 
-    return (pubkey2.GetID() == pubkey.GetID());
+bool CObfuScationSigner::RecoverMessageSigner(const std::vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet)
+{
+    uint256 hashMessage = GetSignedMessageHash(strMessage);
+
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hashMessage, vchSig))
+        return false;
+
+    keyIDRet = pubkey.GetID();
+    messageSigCache.Set(hashMessage, vchSig, keyIDRet);
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
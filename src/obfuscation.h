@@ -48,6 +48,9 @@ class CActiveMasternode;
 #define OBFUSCATION_RELAY_OUT 2
 #define OBFUSCATION_RELAY_SIG 3
 
+// memory used by the cache of verified masternode/budget/SwiftX message signatures
+#define MESSAGE_SIG_CACHE_BYTES (4 << 20)
+
 static const CAmount OBFUSCATION_COLLATERAL = (10 * COIN);
 static const CAmount OBFUSCATION_POOL_MAX = (99999.99 * COIN);
 
@@ -259,6 +262,8 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover the signer of the message and remember it in the verified-message cache, returns true if successful
+    bool RecoverMessageSigner(const std::vector<unsigned char>& vchSig, const std::string& strMessage, CKeyID& keyIDRet);
 };
 
 /** Used to keep track of current status of Obfuscation pool
@@ -515,4 +520,7 @@ public:
 
 void ThreadCheckObfuScationPool();
 
+// To be called once in AppInit2 before any message signature is checked, not needed in lite mode
+void InitMessageSigCache();
+
 #endif
@@ -118,6 +118,8 @@ std::string CMutableTransaction::ToString() const
 void CTransaction::UpdateHash() const
 {
     *const_cast<uint256*>(&hash) = SerializeHash(*this);
+    // anything parsed from the old contents is stale now
+    std::atomic_store(&zerocoinCache, std::shared_ptr<CTxZerocoinCache>());
 }
 
 CTransaction::CTransaction() : hash(), nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0) { }
@@ -126,15 +128,31 @@ CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion
     UpdateHash();
 }
 
+CTransaction::CTransaction(const CTransaction &tx) : hash(tx.hash), zerocoinCache(tx.GetZerocoinCache()), nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime) { }
+
 CTransaction& CTransaction::operator=(const CTransaction &tx) {
     *const_cast<int*>(&nVersion) = tx.nVersion;
     *const_cast<std::vector<CTxIn>*>(&vin) = tx.vin;
     *const_cast<std::vector<CTxOut>*>(&vout) = tx.vout;
     *const_cast<unsigned int*>(&nLockTime) = tx.nLockTime;
     *const_cast<uint256*>(&hash) = tx.hash;
+    std::atomic_store(&zerocoinCache, tx.GetZerocoinCache());
     return *this;
 }
 
+std::shared_ptr<CTxZerocoinCache> CTransaction::GetZerocoinCache() const
+{
+    return std::atomic_load(&zerocoinCache);
+}
+
+std::shared_ptr<CTxZerocoinCache> CTransaction::InitZerocoinCache(const std::shared_ptr<CTxZerocoinCache>& cache) const
+{
+    std::shared_ptr<CTxZerocoinCache> expected;
+    if (std::atomic_compare_exchange_strong(&zerocoinCache, &expected, cache))
+        return cache;
+    return expected;
+}
+
 bool CTransaction::IsCoinStake() const
 {
     if (vin.empty())
@@ -15,8 +15,10 @@
 #include "uint256.h"
 
 #include <list>
+#include <memory>
 
 class CTransaction;
+class CTxZerocoinCache;
 
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
@@ -205,6 +207,10 @@ private:
     const uint256 hash;
     void UpdateHash() const;
 
+    /** Memory only: zerocoin spends and mints parsed from this transaction,
+     *  shared between copies and filled lazily (see zpivchain.cpp). */
+    mutable std::shared_ptr<CTxZerocoinCache> zerocoinCache;
+
 public:
     static const int32_t CURRENT_VERSION=1;
 
@@ -225,6 +231,7 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     CTransaction(const CMutableTransaction &tx);
 
+    CTransaction(const CTransaction& tx);
     CTransaction& operator=(const CTransaction& tx);
 
     ADD_SERIALIZE_METHODS;
@@ -282,6 +289,11 @@ public:
     CAmount GetZerocoinSpent() const;
     int GetZerocoinMintCount() const;
 
+    //! Zerocoin data parsed from this transaction so far, may be NULL
+    std::shared_ptr<CTxZerocoinCache> GetZerocoinCache() const;
+    //! Install cache unless another thread was first; returns the cache in use
+    std::shared_ptr<CTxZerocoinCache> InitZerocoinCache(const std::shared_ptr<CTxZerocoinCache>& cache) const;
+
     bool UsesUTXO(const COutPoint out);
     std::list<COutPoint> GetOutPoints() const;
 
@@ -13,6 +13,8 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <map>
+
 #ifndef WIN32
 #include <arpa/inet.h>
 #endif
@@ -35,7 +37,44 @@ static const char* ppszTypeName[] =
         "mn quorum",
         "mn announce",
         "mn ping",
-        "dstx"};
+        "dstx",
+        "compact block"};
+
+static const char* ppszNetMessageTypes[] =
+    {
+        "version", "verack", "addr", "getaddr", "inv", "getdata", "notfound",
+        "getblocks", "getheaders", "headers", "block", "merkleblock", "tx", "mempool",
+        "ping", "pong", "alert", "reject", "filterload", "filteradd", "filterclear",
+        "sendcmpct", "cmpctblock", "getblocktxn", "blocktxn",
+        "getcfilters", "cfilter", "getcfheaders", "cfheaders", "getcfcheckpt", "cfcheckpt",
+        "ix", "txlvote", "spork", "getsporks",
+        "mnb", "mnp", "dseg", "mnget", "mnw", "mnvs", "ssc", "mprop", "mvote", "fbs", "fbvote",
+        "dsa", "dsc", "dsee", "dseep", "dsf", "dsi", "dsq", "dsr", "dss", "dssu", "dstx"};
+
+static_assert(ARRAYLEN(ppszNetMessageTypes) == NET_MESSAGE_TYPE_COUNT, "NET_MESSAGE_TYPE_COUNT does not match the message type list");
+
+const char* GetNetMessageTypeName(unsigned int nType)
+{
+    if (nType >= NET_MESSAGE_TYPE_COUNT)
+        return "*other*";
+    return ppszNetMessageTypes[nType];
+}
+
+static std::map<std::string, unsigned int> BuildNetMessageTypeIndex()
+{
+    std::map<std::string, unsigned int> mapTypes;
+    for (unsigned int i = 0; i < NET_MESSAGE_TYPE_COUNT; i++)
+        mapTypes[ppszNetMessageTypes[i]] = i;
+    return mapTypes;
+}
+
+unsigned int GetNetMessageTypeIndex(const std::string& strCommand)
+{
+    // built on first use, read-only afterwards
+    static const std::map<std::string, unsigned int> mapTypes = BuildNetMessageTypeIndex();
+    std::map<std::string, unsigned int>::const_iterator it = mapTypes.find(strCommand);
+    return it == mapTypes.end() ? NET_MESSAGE_TYPE_OTHER : it->second;
+}
 
 CMessageHeader::CMessageHeader()
 {
@@ -158,3 +197,11 @@ std::string CInv::ToString() const
 {
     return strprintf("%s %s", GetCommand(), hash.ToString());
 }
+
+std::vector<unsigned char> CInv::GetKey() const
+{
+    std::vector<unsigned char> vKey(hash.begin(), hash.end());
+    for (int i = 0; i < 4; i++)
+        vKey.push_back((type >> (8 * i)) & 0xff);
+    return vKey;
+}
@@ -67,6 +67,16 @@ public:
     unsigned int nChecksum;
 };
 
+/** Message types this node sends or handles, for traffic accounting */
+static const unsigned int NET_MESSAGE_TYPE_COUNT = 57;
+//! Traffic of message types not in the list above is accounted under this index
+static const unsigned int NET_MESSAGE_TYPE_OTHER = NET_MESSAGE_TYPE_COUNT;
+
+//! Name of a message type index, "*other*" for NET_MESSAGE_TYPE_OTHER
+const char* GetNetMessageTypeName(unsigned int nType);
+//! Index of a message type, NET_MESSAGE_TYPE_OTHER if it is unknown
+unsigned int GetNetMessageTypeIndex(const std::string& strCommand);
+
 /** nServices flags */
 enum {
     NODE_NETWORK = (1 << 0),
@@ -81,6 +91,10 @@ enum {
 
 	 NODE_BLOOM_WITHOUT_MN = (1 << 4),
 
+    // NODE_COMPACT_FILTERS means the node keeps a block filter index and answers
+    // getcfilters, getcfheaders and getcfcheckpt requests (BIP 157).
+    NODE_COMPACT_FILTERS = (1 << 6),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -149,6 +163,8 @@ public:
     bool IsMasterNodeType() const;
     const char* GetCommand() const;
     std::string ToString() const;
+    //! Type and hash, for filters that must tell the same hash under different types apart
+    std::vector<unsigned char> GetKey() const;
 
     // TODO: make private (improves encapsulation)
 public:
@@ -174,7 +190,9 @@ enum {
     MSG_MASTERNODE_QUORUM,
     MSG_MASTERNODE_ANNOUNCE,
     MSG_MASTERNODE_PING,
-    MSG_DSTX
+    MSG_DSTX,
+    // Only in getdata, asks for a "cmpctblock" answer (peers that sent "sendcmpct" only)
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
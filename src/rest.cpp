@@ -6,6 +6,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilter.h"
 #include "chain.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
@@ -14,6 +15,7 @@
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
@@ -395,6 +397,61 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_blockfilter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    string hashStr = params[0];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!fBlockFilterIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Block filters are not available (-blockfilterindex)");
+
+    BlockFilter filter;
+    uint256 header;
+    if (!pblockfilterdb->ReadFilter(hash, filter) || !pblockfilterdb->ReadFilterHeader(hash, header))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
+    const std::vector<unsigned char>& vEncoded = filter.GetEncodedFilter();
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryFilter(vEncoded.begin(), vEncoded.end());
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryFilter);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(vEncoded) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objFilter(UniValue::VOBJ);
+        objFilter.push_back(Pair("filter", HexStr(vEncoded)));
+        objFilter.push_back(Pair("header", header.GetHex()));
+        string strJSON = objFilter.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -602,6 +659,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockfilter/", rest_blockfilter},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -122,7 +122,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     UniValue zpivObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zpivObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zpivObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->GetZerocoinSupply(denom) * (denom*COIN))));
     }
     zpivObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.push_back(Pair("zZIJAsupply", zpivObj));
@@ -425,13 +425,63 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilter \"hash\" ( \"filtertype\" )\n"
+            "\nReturns the compact filter of block 'hash' that light clients match their scripts and outpoints against.\n"
+            "Requires -blockfilterindex.\n"
+
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The filter type\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) The hex-encoded filter data\n"
+            "  \"header\" : \"hex\"    (string) The filter header, committing to the filters of all blocks up to this one\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
+
+    uint256 hash(params[0].get_str());
+    if (params.size() > 1 && params[1].get_str() != "basic")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown filtertype");
+
+    if (!fBlockFilterIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filters are not available, restart with -blockfilterindex -reindex");
+
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+
+    BlockFilter filter;
+    uint256 header;
+    if (!pblockfilterdb->ReadFilter(hash, filter) || !pblockfilterdb->ReadFilterHeader(hash, header))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Filter not found, the block was never connected");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time: by default it scans the whole set to calculate \"hash_serialized\".\n"
+            "With hash_type \"muhash\" it returns the incrementally maintained statistics immediately.\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"    (string, optional, default=hash_serialized) Which UTXO set hash to calculate: \"hash_serialized\" or \"muhash\"\n"
 
             "\nResult:\n"
             "{\n"
@@ -440,12 +490,18 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (not with hash_type muhash)\n"
+            "  \"muhash\": \"hash\",            (string) The order-independent rolling hash of the set\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"muhash\"") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
+
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "hash_serialized";
+    if (strHashType != "muhash" && strHashType != "hash_serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid hash_type: " + strHashType);
 
     LOCK(cs_main);
 
@@ -453,18 +509,160 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    // The running statistics may not be available yet; fall back to a scan
+    bool fFullScan = strHashType == "hash_serialized" || !pcoinsTip->GetRunningStats(stats);
+    if (!fFullScan || pcoinsTip->GetStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (fFullScan)
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+UniValue getleveldbinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getleveldbinfo ( \"db\" \"property\" )\n"
+            "\nReturns tuning and size information about the node's LevelDB databases.\n"
+
+            "\nArguments:\n"
+            "1. \"db\"         (string, optional) Only report this database (blockindex, chainstate, zerocoin or sporks)\n"
+            "2. \"property\"   (string, optional) Return this raw LevelDB property instead, e.g. \"leveldb.stats\" or \"leveldb.sstables\"\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                   (object) One entry per database\n"
+            "    \"path\": \"path\",           (string) Location on disk\n"
+            "    \"blocksize\": n,           (numeric) Table block size in bytes\n"
+            "    \"writebuffer\": n,         (numeric) Configured write buffer in bytes, 0 if derived from the cache size\n"
+            "    \"maxopenfiles\": n,        (numeric) Maximum number of open table files\n"
+            "    \"bloombits\": n,           (numeric) Bloom filter bits per key\n"
+            "    \"approximate_bytes\": n,   (numeric) Approximate size on disk\n"
+            "    \"files_per_level\": [n,...] (array) Number of table files at each level\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getleveldbinfo", "") + HelpExampleCli("getleveldbinfo", "\"chainstate\" \"leveldb.stats\"") +
+            HelpExampleRpc("getleveldbinfo", "\"zerocoin\""));
+
+    std::vector<std::string> vNames;
+    if (params.size() > 0)
+        vNames.push_back(params[0].get_str());
+    else
+        vNames = ListLevelDBs();
+
+    if (params.size() > 1) {
+        std::string strValue;
+        if (!GetLevelDBProperty(vNames[0], params[1].get_str(), strValue))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database or property");
+        return strValue;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    BOOST_FOREACH (const std::string& strName, vNames) {
+        CLevelDBStatus status;
+        if (!GetLevelDBStatus(strName, status))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("path", status.strPath));
+        obj.push_back(Pair("blocksize", (uint64_t)status.options.nBlockSize));
+        obj.push_back(Pair("writebuffer", (uint64_t)status.options.nWriteBufferSize));
+        obj.push_back(Pair("maxopenfiles", status.options.nMaxOpenFiles));
+        obj.push_back(Pair("bloombits", status.options.nBloomBits));
+        obj.push_back(Pair("approximate_bytes", status.nApproximateSize));
+        UniValue files(UniValue::VARR);
+        BOOST_FOREACH (int nFiles, status.vFilesPerLevel)
+            files.push_back(nFiles);
+        obj.push_back(Pair("files_per_level", files));
+        ret.push_back(Pair(strName, obj));
+    }
+    return ret;
+}
+
+UniValue getzerocoinfilterinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getzerocoinfilterinfo\n"
+            "\nReturns the state of the in-memory filters in front of the zerocoin database.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"serials\": {             (object) Filter over spent serial numbers, same fields for \"pubcoins\"\n"
+            "    \"loaded\": true|false,   (boolean) Whether the filter is in use (see -zerocoinfilter)\n"
+            "    \"entries\": n,           (numeric) Hashes added since the filter was built\n"
+            "    \"capacity\": n,          (numeric) Entries the filter is sized for before it is rebuilt\n"
+            "    \"memory\": n,            (numeric) Memory used by the filter in bytes\n"
+            "    \"lookups\": n,           (numeric) Lookups that consulted the filter\n"
+            "    \"filtered\": n,          (numeric) Lookups answered without a database read\n"
+            "    \"false_positives\": n,   (numeric) Database reads that found nothing\n"
+            "    \"hit_rate\": x.xxx       (numeric) Fraction of lookups answered without a database read\n"
+            "  },\n"
+            "  \"pubcoins\": {...}\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getzerocoinfilterinfo", "") + HelpExampleRpc("getzerocoinfilterinfo", ""));
+
+    UniValue ret(UniValue::VOBJ);
+    const std::pair<char, std::string> types[] = {std::make_pair('s', std::string("serials")), std::make_pair('m', std::string("pubcoins"))};
+    for (const std::pair<char, std::string>& type : types) {
+        CZerocoinFilterStats stats = zerocoinDB->GetFilterStats(type.first);
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("loaded", stats.fLoaded));
+        obj.push_back(Pair("entries", (uint64_t)stats.nEntries));
+        obj.push_back(Pair("capacity", (uint64_t)stats.nCapacity));
+        obj.push_back(Pair("memory", (uint64_t)stats.nMemoryUsage));
+        obj.push_back(Pair("lookups", stats.nLookups));
+        obj.push_back(Pair("filtered", stats.nFiltered));
+        obj.push_back(Pair("false_positives", stats.nFalsePositives));
+        obj.push_back(Pair("hit_rate", stats.nLookups ? (double)stats.nFiltered / stats.nLookups : 0.0));
+        ret.push_back(Pair(type.second, obj));
+    }
+    return ret;
+}
+
+UniValue getaccumulatorcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getaccumulatorcacheinfo\n"
+            "\nReturns usage statistics of the in-memory accumulator value cache.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": n,       (numeric) Accumulator values currently cached\n"
+            "  \"max_entries\": n,   (numeric) Cache bound (see -accvaluecache)\n"
+            "  \"hits\": n,          (numeric) Lookups served from memory\n"
+            "  \"misses\": n,        (numeric) Lookups that went to the zerocoin database\n"
+            "  \"evictions\": n,     (numeric) Values dropped to stay within the bound\n"
+            "  \"hit_rate\": x.xxx   (numeric) Fraction of lookups served from memory\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaccumulatorcacheinfo", "") + HelpExampleRpc("getaccumulatorcacheinfo", ""));
+
+    CAccumulatorCacheStats stats = accumulatorValueCache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("max_entries", (uint64_t)stats.nMaxEntries));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+    ret.push_back(Pair("hit_rate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -735,55 +933,32 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getfeeinfo", "5") + HelpExampleRpc("getfeeinfo", "5"));
 
-    LOCK(cs_main);
-
     int nBlocks = params[0].get_int();
-    int nBestHeight = chainActive.Height();
-    int nStartHeight = nBestHeight - nBlocks;
-    if (nBlocks < 0 || nStartHeight <= 0)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid start height");
+    std::vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        int nBestHeight = chainActive.Height();
+        int nStartHeight = nBestHeight - nBlocks;
+        if (nBlocks < 0 || nStartHeight <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid start height");
+
+        vBlocks.reserve(nBlocks + 1);
+        for (int i = nStartHeight; i <= nBestHeight; i++)
+            vBlocks.push_back(chainActive[i]);
+    }
 
+    // The per block totals are read from the block statistics index without holding cs_main
     CAmount nFees = 0;
     int64_t nBytes = 0;
     int64_t nTotal = 0;
-    for (int i = nStartHeight; i <= nBestHeight; i++) {
-        CBlockIndex* pindex = chainActive[i];
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase() || tx.IsCoinStake())
-                continue;
-
-            for (unsigned int j = 0; j < tx.vin.size(); j++) {
-                if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
-                    nValueIn += tx.vin[j].nSequence * COIN;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
-                    throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            for (unsigned int j = 0; j < tx.vout.size(); j++) {
-                nValueOut += tx.vout[j].nValue;
-            }
-
-            nFees += nValueIn - nValueOut;
-            nBytes += tx.GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
-            nTotal++;
-        }
-
-        pindex = chainActive.Next(pindex);
-        if (!pindex)
-            break;
+    for (const CBlockIndex* pindex : vBlocks) {
+        CBlockStats stats;
+        if (!GetBlockStats(pindex, stats))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block statistics");
+
+        nFees += stats.nFees;
+        nBytes += stats.nTxBytes;
+        nTotal += stats.nTxCount;
     }
 
     UniValue ret(UniValue::VOBJ);
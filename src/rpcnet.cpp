@@ -78,6 +78,18 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
     }
 }
 
+static UniValue MsgTypeTrafficToJSON(const msgtypetraffic_t& mapTraffic)
+{
+    UniValue obj(UniValue::VOBJ);
+    for (msgtypetraffic_t::const_iterator it = mapTraffic.begin(); it != mapTraffic.end(); ++it) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("bytes", it->second.first));
+        entry.push_back(Pair("count", it->second.second));
+        obj.push_back(Pair(it->first, entry));
+    }
+    return obj;
+}
+
 UniValue getpeerinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -110,7 +122,17 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"sent_per_msg\": {         (json object) Traffic sent to this peer per message type, headers included\n"
+            "       \"type\": {             (string) The message type, \"*other*\" for unknown ones\n"
+            "          \"bytes\": n,        (numeric) Bytes of messages of this type\n"
+            "          \"count\": n         (numeric) Number of messages of this type\n"
+            "       }, ...\n"
+            "    },\n"
+            "    \"recv_per_msg\": {         (json object) Traffic received from this peer per message type, as above\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -161,6 +183,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             obj.push_back(Pair("inflight", heights));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("sent_per_msg", MsgTypeTrafficToJSON(stats.mapSendPerMsgType)));
+        obj.push_back(Pair("recv_per_msg", MsgTypeTrafficToJSON(stats.mapRecvPerMsgType)));
 
         ret.push_back(obj);
     }
@@ -356,7 +380,25 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"uploadtarget\": {\n"
+            "    \"timeframe\": n,                   (numeric) Length of the measuring timeframe in seconds\n"
+            "    \"target\": n,                      (numeric) Target in bytes, 0 if there is none\n"
+            "    \"target_reached\": true|false,     (boolean) True if the target is reached\n"
+            "    \"serve_historical_blocks\": true|false, (boolean) True if serving historical blocks\n"
+            "    \"bytes_sent_in_cycle\": n,         (numeric) Bytes sent in the current timeframe\n"
+            "    \"bytes_left_in_cycle\": n,         (numeric) Bytes left in the current timeframe\n"
+            "    \"time_left_in_cycle\": t           (numeric) Seconds left in the current timeframe\n"
+            "  },\n"
+            "  \"sent_per_msg\": {      (json object) Traffic sent to all peers per message type, headers included\n"
+            "     \"type\": {          (string) The message type, \"*other*\" for unknown ones\n"
+            "        \"bytes\": n,     (numeric) Bytes of messages of this type\n"
+            "        \"count\": n      (numeric) Number of messages of this type\n"
+            "     }, ...\n"
+            "  },\n"
+            "  \"recv_per_msg\": {      (json object) Traffic received from all peers per message type, as above\n"
+            "     ...\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -366,6 +408,21 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    UniValue outboundLimit(UniValue::VOBJ);
+    outboundLimit.push_back(Pair("timeframe", MAX_UPLOAD_TIMEFRAME));
+    outboundLimit.push_back(Pair("target", CNode::GetMaxOutboundTarget()));
+    outboundLimit.push_back(Pair("target_reached", CNode::OutboundTargetReached()));
+    outboundLimit.push_back(Pair("serve_historical_blocks", !CNode::OutboundTargetReached()));
+    outboundLimit.push_back(Pair("bytes_sent_in_cycle", CNode::GetOutboundBytesSentInCycle()));
+    outboundLimit.push_back(Pair("bytes_left_in_cycle", CNode::GetOutboundTargetBytesLeft()));
+    outboundLimit.push_back(Pair("time_left_in_cycle", CNode::GetMaxOutboundTimeLeftInCycle()));
+    obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    msgtypetraffic_t mapSent, mapRecv;
+    CNode::GetTotalTraffic(mapSent, mapRecv);
+    obj.push_back(Pair("sent_per_msg", MsgTypeTrafficToJSON(mapSent)));
+    obj.push_back(Pair("recv_per_msg", MsgTypeTrafficToJSON(mapRecv)));
     return obj;
 }
 
@@ -80,6 +80,7 @@ public:
 
     bool SignatureValid();
     bool Sign();
+    std::string GetStrMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
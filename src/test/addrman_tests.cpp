@@ -0,0 +1,136 @@
+// Copyright (c) 2012-2014 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addrman.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "streams.h"
+#include "version.h"
+
+#include <set>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+static CAddress ResolveAddress(const string& strIp, unsigned short nPort = 8333)
+{
+    CAddress addr(CService(CNetAddr(strIp), nPort));
+    addr.nTime = GetAdjustedTime();
+    return addr;
+}
+
+BOOST_AUTO_TEST_SUITE(addrman_tests)
+
+BOOST_AUTO_TEST_CASE(addrman_simple)
+{
+    CAddrMan addrman;
+    CNetAddr source("252.2.2.2");
+
+    // Test 1: Does Addrman respond correctly when empty.
+    BOOST_CHECK_EQUAL(addrman.size(), 0);
+    CAddress addrNull = addrman.Select();
+    BOOST_CHECK(addrNull.ToString() == "[::]:0");
+
+    // Test 2: Does Addrman::Add work as expected.
+    CAddress addr1 = ResolveAddress("250.1.1.1");
+    BOOST_CHECK(addrman.Add(addr1, source));
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK(addrman.Select() == addr1);
+
+    // Test 3: Does IP address deduplication work correctly.
+    BOOST_CHECK(!addrman.Add(ResolveAddress("250.1.1.1", 8334), source));
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+
+    // Test 4: Moving the only entry to tried keeps it selectable.
+    addrman.Good(addr1);
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK(addrman.Select() == addr1);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_select_both_tables)
+{
+    CAddrMan addrman;
+    CNetAddr source("252.2.2.2");
+
+    set<CService> setTried;
+    for (int i = 1; i <= 64; i++) {
+        CAddress addr = ResolveAddress(strprintf("250.%i.1.1", i));
+        addrman.Add(addr, source);
+        if (i % 2 == 0) {
+            addrman.Good(addr);
+            setTried.insert(addr);
+        }
+    }
+    BOOST_CHECK_EQUAL(addrman.size(), 64);
+
+    // Selection draws from the occupied positions only, both tables must show up quickly
+    int nTried = 0;
+    int nNew = 0;
+    for (int i = 0; i < 200; i++) {
+        CAddress addr = addrman.Select();
+        BOOST_CHECK(addr.IsValid());
+        if (setTried.count(addr))
+            nTried++;
+        else
+            nNew++;
+    }
+    BOOST_CHECK(nTried > 0);
+    BOOST_CHECK(nNew > 0);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_getaddr)
+{
+    CAddrMan addrman;
+
+    for (unsigned int i = 1; i < 200; i++) {
+        CAddress addr = ResolveAddress(strprintf("250.%i.%i.%i", i % 256, (i >> 8) % 256, i % 7 + 1));
+        addrman.Add(addr, CNetAddr(strprintf("251.%i.1.1", i % 16)));
+    }
+
+    vector<CAddress> vAddr = addrman.GetAddr();
+    BOOST_CHECK(vAddr.size() <= ADDRMAN_GETADDR_MAX_PCT * (unsigned int)addrman.size() / 100);
+    BOOST_CHECK(!vAddr.empty());
+
+    // no duplicates among the returned addresses
+    set<CService> setAddr(vAddr.begin(), vAddr.end());
+    BOOST_CHECK_EQUAL(setAddr.size(), vAddr.size());
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialize_streaming)
+{
+    CAddrMan addrman;
+    CNetAddr source("252.2.2.2");
+    for (int i = 1; i <= 100; i++) {
+        CAddress addr = ResolveAddress(strprintf("250.%i.2.1", i));
+        addrman.Add(addr, source);
+        if (i % 3 == 0)
+            addrman.Good(addr);
+    }
+
+    // Hashing while writing gives the same checksum as hashing the serialized buffer
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    CHashForwarder<CDataStream> hashout(&ssPeers);
+    hashout << addrman;
+    uint256 hash = hashout.GetHash();
+    BOOST_CHECK(hash == Hash(ssPeers.begin(), ssPeers.end()));
+
+    CAddrMan addrman2;
+    CHashVerifier<CDataStream> hashin(&ssPeers);
+    hashin >> addrman2;
+    BOOST_CHECK(hashin.GetHash() == hash);
+    BOOST_CHECK(ssPeers.empty());
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+
+    // The rebuilt occupancy lists serialize the same number of positions
+    CDataStream ss1(SER_DISK, CLIENT_VERSION), ss2(SER_DISK, CLIENT_VERSION);
+    ss1 << addrman;
+    ss2 << addrman2;
+    BOOST_CHECK_EQUAL(ss1.size(), ss2.size());
+    BOOST_CHECK(addrman2.Select().IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Compares the per-peer known inventory and known address tracking of
+// CRollingBloomFilter with the mruset it replaced, in memory and time.
+
+#include "bloom.h"
+#include "mruset.h"
+#include "net.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+// operations timed per container
+#define BENCH_ROLLINGBLOOM_OPS 200000
+
+// Heap usage of an allocation of nSize bytes, as glibc malloc rounds it
+static size_t MallocUsage(size_t nSize)
+{
+    return ((nSize + 8 + 15) >> 4) << 4;
+}
+
+// std::set node: color and three pointers before the element; mruset also queues a copy
+template <typename T>
+static size_t MruSetUsage(const mruset<T>& set)
+{
+    return set.size() * (MallocUsage(sizeof(T) + 4 * sizeof(void*)) + sizeof(T));
+}
+
+static CAddress RandomAddress()
+{
+    struct in_addr ip;
+    ip.s_addr = (uint32_t)GetRand(std::numeric_limits<uint32_t>::max());
+    return CAddress(CService(ip, (unsigned short)GetRand(65536)));
+}
+
+static void Report(const string& strName, size_t nMemory, int64_t nTimeMicros)
+{
+    BOOST_TEST_MESSAGE("  " << strName << ": " << nMemory / 1024 << " KiB, "
+                            << nTimeMicros * 1000 / BENCH_ROLLINGBLOOM_OPS << " ns per insert+lookup");
+}
+
+BOOST_AUTO_TEST_SUITE(benchmark_rollingbloom)
+
+BOOST_AUTO_TEST_CASE(benchmark_inventory_known)
+{
+    vector<uint256> vHash;
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++)
+        vHash.push_back(GetRandHash());
+
+    BOOST_TEST_MESSAGE("Known inventory, " << INVENTORY_KNOWN_FILTER_SIZE << " entries:");
+
+    // Every step remembers a new item and looks up one of the last hundred
+    mruset<CInv> setInventoryKnown(INVENTORY_KNOWN_FILTER_SIZE);
+    int nMissing = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++) {
+        setInventoryKnown.insert(CInv(MSG_TX, vHash[i]));
+        nMissing += !setInventoryKnown.count(CInv(MSG_TX, vHash[i - i % 100]));
+    }
+    Report("mruset<CInv>", MruSetUsage(setInventoryKnown), GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(nMissing, 0);
+
+    // Keyed on type and hash, as SendMessages and AddInventoryKnown do
+    CRollingBloomFilter filterInventoryKnown(INVENTORY_KNOWN_FILTER_SIZE, INVENTORY_KNOWN_FILTER_FPRATE);
+    nStart = GetTimeMicros();
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++) {
+        filterInventoryKnown.insert(CInv(MSG_TX, vHash[i]).GetKey());
+        nMissing += !filterInventoryKnown.contains(CInv(MSG_TX, vHash[i - i % 100]).GetKey());
+    }
+    Report("CRollingBloomFilter", filterInventoryKnown.GetMemoryUsage(), GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(nMissing, 0);
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_addr_known)
+{
+    vector<CAddress> vAddr;
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++)
+        vAddr.push_back(RandomAddress());
+
+    BOOST_TEST_MESSAGE("Known addresses, " << ADDR_KNOWN_FILTER_SIZE << " entries:");
+
+    mruset<CAddress> setAddrKnown(ADDR_KNOWN_FILTER_SIZE);
+    int nMissing = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++) {
+        setAddrKnown.insert(vAddr[i]);
+        nMissing += !setAddrKnown.count(vAddr[i - i % 100]);
+    }
+    Report("mruset<CAddress>", MruSetUsage(setAddrKnown), GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(nMissing, 0);
+
+    CRollingBloomFilter addrKnown(ADDR_KNOWN_FILTER_SIZE, ADDR_KNOWN_FILTER_FPRATE);
+    nStart = GetTimeMicros();
+    for (int i = 0; i < BENCH_ROLLINGBLOOM_OPS; i++) {
+        addrKnown.insert(vAddr[i].GetKey());
+        nMissing += !addrKnown.contains(vAddr[i - i % 100].GetKey());
+    }
+    Report("CRollingBloomFilter", addrKnown.GetMemoryUsage(), GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(nMissing, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,162 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(3);
+    block.vtx[0] = tx;
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    block.vtx[1] = tx;
+
+    tx.vin.resize(10);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout.hash = GetRandHash();
+        tx.vin[i].prevout.n = 0;
+    }
+    block.vtx[2] = tx;
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblockRead;
+    stream >> cmpctblockRead;
+    return cmpctblockRead;
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+    pool.addUnchecked(block.vtx[1].GetHash(), CTxMemPoolEntry(block.vtx[1], 0, 0, 0, 0));
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0, 0));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK(block2.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(MissingTransactionsTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0, 0));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, pool) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    BlockTransactionsRequest req;
+    req.blockhash = block.GetHash();
+    req.indexes.push_back(1);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest reqRead;
+    stream >> reqRead;
+    BOOST_CHECK(reqRead.blockhash == req.blockhash);
+    BOOST_CHECK(reqRead.indexes == req.indexes);
+
+    // Too many transactions sent back
+    PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+    CBlock block2;
+    BOOST_CHECK(partialBlockCopy.FillBlock(block2, std::vector<CTransaction>(2, block.vtx[1])) == READ_STATUS_INVALID);
+
+    // The wrong transaction only shows up in the merkle root
+    partialBlockCopy = partialBlock;
+    BOOST_CHECK(partialBlockCopy.FillBlock(block2, std::vector<CTransaction>(1, block.vtx[2])) == READ_STATUS_FAILED);
+
+    BlockTransactions resp(reqRead);
+    resp.txn[0] = block.vtx[1];
+    BOOST_CHECK(partialBlock.FillBlock(block2, resp.txn) == READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(HeaderBlockTest)
+{
+    CBlock block(BuildBlockTestCase());
+    block.vchBlockSig.assign(72, 0x42);
+
+    // Proof of work: only the coinbase comes along with the header
+    CBlock headerBlock = RoundTrip(CBlockHeaderAndShortTxIDs(block)).GetHeaderBlock();
+    BOOST_CHECK(headerBlock.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(headerBlock.vtx.size(), 1U);
+    BOOST_CHECK(headerBlock.vtx[0].GetHash() == block.vtx[0].GetHash());
+    BOOST_CHECK(headerBlock.vchBlockSig == block.vchBlockSig);
+
+    // Proof of stake: the coinstake too, which is all the stake check needs
+    CMutableTransaction txCoinStake(block.vtx[1]);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = 42;
+    block.vtx[1] = txCoinStake;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    BOOST_CHECK(block.IsProofOfStake());
+
+    headerBlock = RoundTrip(CBlockHeaderAndShortTxIDs(block)).GetHeaderBlock();
+    BOOST_CHECK(headerBlock.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(headerBlock.vtx.size(), 2U);
+    BOOST_CHECK(headerBlock.IsProofOfStake());
+    BOOST_CHECK(headerBlock.vtx[1].GetHash() == block.vtx[1].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req;
+    req.blockhash = GetRandHash();
+    req.indexes.push_back(0);
+    req.indexes.push_back(1);
+    req.indexes.push_back(3);
+    req.indexes.push_back(4);
+    req.indexes.push_back(std::numeric_limits<uint16_t>::max());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+
+    BlockTransactionsRequest reqRead;
+    stream >> reqRead;
+    BOOST_CHECK(reqRead.blockhash == req.blockhash);
+    BOOST_CHECK(reqRead.indexes == req.indexes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+static GCSFilter::Element RandomElement()
+{
+    uint256 hash = GetRandHash();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+BOOST_AUTO_TEST_CASE(siphash_bytes)
+{
+    // Reference vectors of the SipHash-2-4 paper, key 00 01 .. 0f, message 00 01 .. (len - 1)
+    uint64_t k0 = 0x0706050403020100ULL, k1 = 0x0F0E0D0C0B0A0908ULL;
+    unsigned char msg[32];
+    for (int i = 0; i < 32; i++)
+        msg[i] = i;
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, msg, 0), 0x726fdb47dd0e0e31ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, msg, 1), 0x74f839c593dc67fdULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, msg, 8), 0x93f5f5799a932462ULL);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, msg, 15), 0xa129ca6149be45e5ULL);
+
+    uint256 val;
+    memcpy(val.begin(), msg, 32);
+    BOOST_CHECK_EQUAL(SipHash(k0, k1, msg, 32), SipHashUint256(k0, k1, val));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    GCSFilter filter(0, 0, 10, 1 << 10, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (GCSFilter::ElementSet::const_iterator it = included.begin(); it != included.end(); ++it)
+        BOOST_CHECK(filter.Match(*it));
+    BOOST_CHECK(filter.MatchAny(included));
+
+    // With M = 2^20 a hundred random elements essentially never match
+    GCSFilter filterStrict(1, 2, 20, 1 << 20, included);
+    BOOST_CHECK(!filterStrict.MatchAny(excluded));
+
+    // Decoding keeps the contents
+    GCSFilter filterDecoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filterDecoded.GetN(), 100U);
+    for (GCSFilter::ElementSet::const_iterator it = included.begin(); it != included.end(); ++it)
+        BOOST_CHECK(filterDecoded.Match(*it));
+
+    // Truncated data is rejected
+    std::vector<unsigned char> vTruncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 20);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, vTruncated), std::ios_base::failure);
+
+    GCSFilter empty(0, 0, 10, 1 << 10, GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(empty.GetEncoded().size(), 1U);
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[3], excluded_scripts[2];
+    included_scripts[0] << std::vector<unsigned char>(33, 1) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    included_scripts[2] << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUAL;
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(4, 4);
+    excluded_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig << OP_1;
+    coinbase.vout.resize(2);
+    coinbase.vout[0].scriptPubKey = included_scripts[0];
+    coinbase.vout[1].scriptPubKey = excluded_scripts[0];
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 3);
+    tx.vout.resize(3);
+    tx.vout[0].scriptPubKey = included_scripts[1];
+    tx.vout[1].scriptPubKey = included_scripts[2];
+
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    BlockFilter blockFilter(BASIC_FILTER, block);
+    const GCSFilter& filter = blockFilter.GetFilter();
+    // three scripts and the spent outpoint; the empty script and OP_RETURN are left out
+    BOOST_CHECK_EQUAL(filter.GetN(), 4U);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(filter.Match(GCSFilter::Element(included_scripts[i].begin(), included_scripts[i].end())));
+    for (int i = 0; i < 2; i++)
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_scripts[i].begin(), excluded_scripts[i].end())));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx.vin[0].prevout;
+    BOOST_CHECK(filter.Match(GCSFilter::Element(ss.begin(), ss.end())));
+
+    // Round trip through the encoding, as served to peers
+    BlockFilter blockFilterDecoded(BASIC_FILTER, block.GetHash(), blockFilter.GetEncodedFilter());
+    BOOST_CHECK(blockFilterDecoded.GetHash() == blockFilter.GetHash());
+    BOOST_CHECK(blockFilterDecoded.GetFilter().Match(GCSFilter::Element(included_scripts[1].begin(), included_scripts[1].end())));
+    BOOST_CHECK_THROW(BlockFilter(1, block.GetHash(), blockFilter.GetEncodedFilter()), std::ios_base::failure);
+
+    // Headers chain: a different previous header gives a different header
+    uint256 hashFilter = blockFilter.GetHash(), zero;
+    uint256 header = blockFilter.ComputeHeader(zero);
+    BOOST_CHECK(header == Hash(hashFilter.begin(), hashFilter.end(), zero.begin(), zero.end()));
+    BOOST_CHECK(blockFilter.ComputeHeader(header) != header);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
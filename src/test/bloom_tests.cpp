@@ -11,6 +11,8 @@
 #include "clientversion.h"
 #include "key.h"
 #include "merkleblock.h"
+#include "protocol.h"
+#include "random.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
@@ -462,4 +464,84 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256("0x02981fa052f0481dbc5868f4fc2166035a10f27a03cfd2de67326471df5bc041"), 0)));
 }
 
+BOOST_AUTO_TEST_CASE(hash_bloom_filter)
+{
+    CHashBloomFilter filter(1000, GetRand(std::numeric_limits<uint64_t>::max()));
+    std::vector<uint256> vHash;
+    for (int i = 0; i < 1000; i++) {
+        vHash.push_back(GetRandHash());
+        filter.insert(vHash.back());
+    }
+    BOOST_CHECK(!filter.IsOverfull());
+    for (const uint256& hash : vHash)
+        BOOST_CHECK(filter.contains(hash));
+
+    // sized for 12 bits and 8 probes per element, expect well under 2% false positives
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+        nFalsePositives += filter.contains(GetRandHash());
+    BOOST_CHECK(nFalsePositives < 200);
+
+    filter.insert(GetRandHash());
+    BOOST_CHECK(filter.IsOverfull());
+
+    filter.clear();
+    BOOST_CHECK_EQUAL(filter.GetInserted(), 0U);
+    BOOST_CHECK(!filter.contains(vHash[0]));
+}
+
+static std::vector<unsigned char> RandomData()
+{
+    uint256 r = GetRandHash();
+    return std::vector<unsigned char>(r.begin(), r.end());
+}
+
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    // last-100-entry, 1% false positive
+    CRollingBloomFilter rb1(100, 0.01);
+
+    // Overfill
+    static const int DATASIZE = 399;
+    std::vector<unsigned char> data[DATASIZE];
+    for (int i = 0; i < DATASIZE; i++) {
+        data[i] = RandomData();
+        rb1.insert(data[i]);
+    }
+    // Last 100 guaranteed to be remembered
+    for (int i = 299; i < DATASIZE; i++)
+        BOOST_CHECK(rb1.contains(data[i]));
+
+    // The filter is as full as it gets right before a new generation starts,
+    // expect about 100 false positives out of 10,000
+    int nHits = 0;
+    for (int i = 0; i < 10000; i++)
+        nHits += rb1.contains(RandomData());
+    BOOST_CHECK(nHits > 25);
+    BOOST_CHECK(nHits < 175);
+
+    BOOST_CHECK(rb1.contains(data[DATASIZE - 1]));
+    rb1.reset();
+    BOOST_CHECK(!rb1.contains(data[DATASIZE - 1]));
+
+    // Inventory keys as the per-peer known inventory uses them
+    CRollingBloomFilter rb2(1000, 0.001);
+    std::vector<uint256> vHash;
+    for (int i = 0; i < 2000; i++) {
+        vHash.push_back(GetRandHash());
+        rb2.insert(CInv(MSG_TX, vHash.back()).GetKey());
+    }
+    for (int i = 1000; i < 2000; i++)
+        BOOST_CHECK(rb2.contains(CInv(MSG_TX, vHash[i]).GetKey()));
+    // Two generations back is forgotten
+    int nOld = 0;
+    for (int i = 0; i < 500; i++)
+        nOld += rb2.contains(CInv(MSG_TX, vHash[i]).GetKey());
+    BOOST_CHECK(nOld < 10);
+    nHits = 0;
+    for (int i = 0; i < 10000; i++)
+        nHits += rb2.contains(CInv(MSG_TX, GetRandHash()).GetKey());
+    BOOST_CHECK(nHits < 40);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -31,4 +31,42 @@ BOOST_AUTO_TEST_CASE(budget_value)
     CheckBudgetValue(nHeightTest, "mainnet", 43200*COIN);
 }
 
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    CBudgetProposal proposal;
+    std::string strError;
+
+    // Three masternodes vote yes, yes and no
+    std::vector<CBudgetVote> vVotes;
+    for (int i = 0; i < 3; i++) {
+        CTxIn vin(COutPoint(uint256(i + 1), 0));
+        vVotes.push_back(CBudgetVote(vin, proposal.GetHash(), i < 2 ? VOTE_YES : VOTE_NO));
+        vVotes.back().nTime = GetTime() - 2 * BUDGET_VOTE_UPDATE_MIN;
+        BOOST_CHECK(proposal.AddOrUpdateVote(vVotes.back(), strError));
+    }
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 2);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 0);
+
+    // The first one changes its mind: the old vote no longer counts
+    CBudgetVote vote = vVotes[0];
+    vote.nVote = VOTE_ABSTAIN;
+    vote.nTime = GetTime();
+    BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 1);
+
+    // Rejected updates leave the tallies alone
+    vote.nVote = VOTE_NO;
+    BOOST_CHECK(!proposal.AddOrUpdateVote(vote, strError));
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetRatio(), 0.5);
+
+    // Copies carry their tallies along
+    CBudgetProposal proposalCopy(proposal);
+    BOOST_CHECK_EQUAL(proposalCopy.GetYeas(), 1);
+    BOOST_CHECK_EQUAL(proposalCopy.GetAbstains(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -83,6 +83,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool prefetched_entries = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<uint256, CCoins> result;
@@ -123,6 +124,16 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             }
         }
 
+        // Occasionally pull a batch of entries into the tip ahead of use;
+        // this must not change what the stack represents.
+        if (insecure_rand() % 500 == 0) {
+            std::vector<uint256> batch;
+            for (unsigned int j = 0; j < 16; j++)
+                batch.push_back(txids[insecure_rand() % txids.size()]);
+            stack.back()->PrefetchCoins(batch);
+            prefetched_entries = true;
+        }
+
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
             for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
@@ -173,6 +184,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(prefetched_entries);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
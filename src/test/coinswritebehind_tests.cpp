@@ -0,0 +1,189 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "amount.h"
+#include "coins.h"
+#include "random.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+// In-memory coins view whose writes wait until the test releases them
+class CCoinsViewGated : public CCoinsView
+{
+    mutable boost::mutex cs;
+    boost::condition_variable condRelease;
+    bool fReleased;
+    int nWrites;
+    uint256 hashBestBlock_;
+    std::map<uint256, CCoins> map_;
+
+public:
+    CCoinsViewGated() : fReleased(false), nWrites(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        if (it == map_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        CCoins coins;
+        return GetCoins(txid, coins) && !coins.IsPruned();
+    }
+
+    uint256 GetBestBlock() const
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return hashBestBlock_;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (!fReleased)
+            condRelease.wait(lock);
+        // Like CCoinsViewDB, leave the map as it was handed over
+        for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                map_[it->first] = it->second.coins;
+        }
+        hashBestBlock_ = hashBlock;
+        nWrites++;
+        return true;
+    }
+
+    void Release()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fReleased = true;
+        }
+        condRelease.notify_all();
+    }
+
+    int GetWrites() const
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return nWrites;
+    }
+};
+
+// Add a coin with a single output of nValue for txid to the cache
+void AddCoin(CCoinsViewCache& cache, const uint256& txid, CAmount nValue)
+{
+    CCoinsModifier coins = cache.ModifyCoins(txid);
+    coins->nVersion = 1;
+    coins->vout.resize(1);
+    coins->vout[0].nValue = nValue;
+    coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+}
+
+void DeleteView(CCoinsViewWriteBehind* pview)
+{
+    delete pview;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(coinswritebehind_tests)
+
+BOOST_AUTO_TEST_CASE(coinswritebehind_flush_while_reading)
+{
+    CCoinsViewGated base;
+    CCoinsViewWriteBehind writebehind(&base, NULL);
+    uint256 txidFirst = GetRandHash();
+    uint256 txidSecond = GetRandHash();
+    uint256 hashFirst = GetRandHash();
+    uint256 hashSecond = GetRandHash();
+
+    {
+        CCoinsViewCache cache(&writebehind);
+        AddCoin(cache, txidFirst, 1 * COIN);
+        cache.SetBestBlock(hashFirst);
+        // Hands the entries over without waiting for the write
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // The writer is stuck in the base; everything is served from the flushed map
+    MilliSleep(10);
+    BOOST_CHECK_EQUAL(base.GetWrites(), 0);
+    BOOST_CHECK(!base.HaveCoins(txidFirst));
+    BOOST_CHECK(writebehind.HaveCoins(txidFirst));
+    BOOST_CHECK(!writebehind.HaveCoins(txidSecond));
+    BOOST_CHECK(writebehind.GetBestBlock() == hashFirst);
+
+    std::vector<uint256> vTxid;
+    vTxid.push_back(txidFirst);
+    vTxid.push_back(txidSecond);
+    std::vector<std::pair<uint256, CCoins> > vCoins;
+    writebehind.GetCoinsBatch(vTxid, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+    BOOST_CHECK(vCoins[0].first == txidFirst);
+    BOOST_CHECK_EQUAL(vCoins[0].second.vout[0].nValue, 1 * COIN);
+
+    // A cache on top keeps reading and modifying while the write is pending
+    CCoinsViewCache cache(&writebehind);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txidFirst)->vout[0].nValue, 1 * COIN);
+    cache.ModifyCoins(txidFirst)->Spend(0);
+    AddCoin(cache, txidSecond, 2 * COIN);
+    cache.SetBestBlock(hashSecond);
+
+    // The next flush waits for the pending write before handing its entries over
+    boost::thread threadFlush(boost::bind(&CCoinsViewCache::Flush, &cache));
+    MilliSleep(10);
+    BOOST_CHECK_EQUAL(base.GetWrites(), 0);
+    BOOST_CHECK(writebehind.GetBestBlock() == hashFirst);
+
+    base.Release();
+    threadFlush.join();
+    BOOST_CHECK(writebehind.WaitForWrites());
+    BOOST_CHECK_EQUAL(base.GetWrites(), 2);
+    BOOST_CHECK(base.GetBestBlock() == hashSecond);
+    BOOST_CHECK(!base.HaveCoins(txidFirst));
+    BOOST_CHECK(base.HaveCoins(txidSecond));
+    BOOST_CHECK(!writebehind.HaveCoins(txidFirst));
+    BOOST_CHECK(writebehind.HaveCoins(txidSecond));
+    BOOST_CHECK(writebehind.GetBestBlock() == hashSecond);
+}
+
+BOOST_AUTO_TEST_CASE(coinswritebehind_shutdown_with_write_pending)
+{
+    CCoinsViewGated base;
+    CCoinsViewWriteBehind* pwritebehind = new CCoinsViewWriteBehind(&base, NULL);
+    uint256 txid = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+
+    {
+        CCoinsViewCache cache(pwritebehind);
+        AddCoin(cache, txid, 1 * COIN);
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Shutting down finishes the pending write rather than dropping it
+    boost::thread threadShutdown(boost::bind(&DeleteView, pwritebehind));
+    MilliSleep(10);
+    BOOST_CHECK_EQUAL(base.GetWrites(), 0);
+
+    base.Release();
+    threadShutdown.join();
+    BOOST_CHECK_EQUAL(base.GetWrites(), 1);
+    BOOST_CHECK(base.HaveCoins(txid));
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
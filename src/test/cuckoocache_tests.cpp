@@ -0,0 +1,136 @@
+// Copyright (c) 2012-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** Test Suite for CuckooCache
+ *
+ *  1) All tests should have a deterministic result (using insecure rand
+ *  with deterministic seeds)
+ *  2) Some test methods are templated to allow for easier testing
+ *  against new versions / comparing
+ *  3) Results should be treated as a regression test, i.e., did the behavior
+ *  change significantly from what was expected. This can be OK, depending on
+ *  the nature of the change, but requires updating the tests to reflect the new
+ *  expected behavior. For example improving the hit rate may cause some tests
+ *  using BOOST_CHECK_CLOSE to fail.
+ *
+ */
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> sigcache_type;
+
+/** insecure_GetRandHash fills in a uint256 from insecure_rand
+ */
+static void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Test that no values not inserted into the cache are read out of it.
+ *
+ * There are no repeats in the first 200000 insecure_GetRandHash calls
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    sigcache_type cc;
+    cc.setup_bytes(32 << 20);
+    uint256 v;
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+    }
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        BOOST_CHECK(!cc.contains(v, false));
+    }
+}
+
+/** This helper returns the hit rate when megabytes*load worth of entries are
+ * inserted into a megabytes sized cache
+ */
+static double test_cache(size_t megabytes, double load)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> hashes;
+    sigcache_type set;
+    size_t bytes = megabytes * (1 << 20);
+    set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(load * (bytes / sizeof(uint256)));
+    hashes.resize(n_insert);
+    for (uint32_t i = 0; i < n_insert; ++i)
+        insecure_GetRandHash(hashes[i]);
+    // We make a copy of the hashes because future optimizations of the
+    // cuckoocache may overwrite the inserted element, so the test is
+    // "future proofed".
+    std::vector<uint256> hashes_insert_copy = hashes;
+    for (uint32_t i = 0; i < n_insert; ++i)
+        set.insert(hashes_insert_copy[i]);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n_insert; ++i)
+        if (set.contains(hashes[i], false))
+            ++count;
+    return double(count) / double(n_insert);
+}
+
+/** This helper checks that the hit rate is reasonable for a range of loads
+ * up to the designed 90% occupancy.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
+{
+    /** Arbitrarily selected Hit Rate threshold that happens to work for this test
+     * as a lower bound on performance.
+     */
+    double HitRateThresh = 0.98;
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = test_cache(megabytes, load);
+        BOOST_CHECK(hits >= std::min(HitRateThresh, HitRateThresh / load));
+    }
+}
+
+/** Erased entries stay readable until their slot is needed by a later
+ * insert, and a full table always prefers reusing erased slots.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
+{
+    seed_insecure_rand(true);
+    sigcache_type set;
+    size_t bytes = 1 << 20;
+    set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(0.45 * (bytes / sizeof(uint256)));
+    std::vector<uint256> hashes(n_insert * 2);
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+        insecure_GetRandHash(hashes[i]);
+
+    // Insert the first half and erase all of it on lookup, as a block
+    // connect would do.
+    for (uint32_t i = 0; i < n_insert; ++i)
+        set.insert(hashes[i]);
+    for (uint32_t i = 0; i < n_insert; ++i)
+        BOOST_CHECK(set.contains(hashes[i], true));
+    // Erase is lazy: the entries are still present.
+    for (uint32_t i = 0; i < n_insert; ++i)
+        BOOST_CHECK(set.contains(hashes[i], false));
+
+    // The second half must fit by reusing the erased slots.
+    for (uint32_t i = n_insert; i < hashes.size(); ++i)
+        set.insert(hashes[i]);
+    uint32_t count = 0;
+    for (uint32_t i = n_insert; i < hashes.size(); ++i)
+        if (set.contains(hashes[i], false))
+            ++count;
+    BOOST_CHECK(double(count) / double(n_insert) >= 0.98);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -46,4 +46,11 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // SipHash-2-4 reference vector for the 32 byte message 00 01 .. 1f under the key 00 01 .. 0f
+    uint256 x("0x1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x), 0x7127512f72f27cceULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -50,4 +50,31 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(raw_block_cache)
+{
+    CRawBlockCache cache(250);
+    uint256 hash[3];
+    for (int i = 0; i < 3; i++) {
+        hash[i] = uint256(i + 1);
+        cache.Insert(hash[i], CRawBlockCache::RawBlockRef(new std::vector<unsigned char>(100, i)));
+    }
+    // The byte limit evicted the oldest block
+    BOOST_CHECK_EQUAL(cache.GetCount(), 2U);
+    BOOST_CHECK_EQUAL(cache.GetBytes(), 200U);
+    BOOST_CHECK(!cache.Get(hash[0]));
+    BOOST_CHECK(cache.Get(hash[1]) && (*cache.Get(hash[1]))[0] == 1);
+
+    // hash[1] was used last, hash[2] goes first
+    cache.Insert(hash[0], CRawBlockCache::RawBlockRef(new std::vector<unsigned char>(100, 0)));
+    BOOST_CHECK(!cache.Get(hash[2]));
+    BOOST_CHECK(cache.Get(hash[1]));
+    BOOST_CHECK(cache.Get(hash[0]));
+
+    // A reference handed out stays valid after eviction
+    CRawBlockCache::RawBlockRef pblock = cache.Get(hash[1]);
+    cache.SetMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 0U);
+    BOOST_CHECK_EQUAL(pblock->size(), 100U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
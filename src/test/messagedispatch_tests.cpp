@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "masternode-payments.h"
+#include "masternode-sync.h"
+#include "messagedispatch.h"
+#include "net.h"
+#include "utiltime.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+// A complete message as ReceiveMsgBytes hands it to ProcessMessages
+static CNetMessage MakeMessage(const char* pszCommand, const CDataStream& ssPayload)
+{
+    CNetMessage msg(SER_NETWORK, PROTOCOL_VERSION);
+    msg.hdr = CMessageHeader(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&msg.hdr.nChecksum, &hash, sizeof(msg.hdr.nChecksum));
+    msg.vRecv += ssPayload;
+    msg.in_data = true;
+    msg.nDataPos = ssPayload.size();
+    msg.nTime = GetTimeMicros();
+    return msg;
+}
+
+BOOST_AUTO_TEST_SUITE(messagedispatch_tests)
+
+BOOST_AUTO_TEST_CASE(messagedispatch_commands)
+{
+    // Everything that adds to the maps getdata is served from stays on the message handler thread
+    const char* ppszHandlerCommands[] = {"mnb", "mnp", "dseg", "mnw", "ssc", "mprop", "mvote", "fbs", "fbvote",
+                                         "ix", "txlvote", "spork", "getsporks", "getdata", "inv", "tx", "block"};
+    for (unsigned int i = 0; i < sizeof(ppszHandlerCommands) / sizeof(ppszHandlerCommands[0]); i++)
+        BOOST_CHECK(!CMessageDispatcher::IsDispatchedCommand(ppszHandlerCommands[i]));
+    BOOST_CHECK(CMessageDispatcher::IsDispatchedCommand("mnget"));
+    BOOST_CHECK(CMessageDispatcher::IsDispatchedCommand("mnvs"));
+}
+
+BOOST_AUTO_TEST_CASE(messagedispatch_alongside_getdata)
+{
+    // The payment handlers ignore everything until the chain looks synced
+    SetMockTime(chainActive.Tip()->GetBlockTime() + 60);
+    BOOST_CHECK(masternodeSync.IsBlockchainSynced());
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++)
+        threadGroup.create_thread(&ThreadMessageDispatch);
+    while (!messageDispatcher.IsActive())
+        MilliSleep(1);
+
+    struct in_addr ip;
+    ip.s_addr = 0xa0b0c001;
+    CNode node(INVALID_SOCKET, CAddress(CService(ip, Params().GetDefaultPort())), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+
+    for (int i = 0; i < 200; i++) {
+        // A vote added the way "mnw" adds it on the handler thread
+        CMasternodePaymentWinner winner;
+        winner.nBlockHeight = i % 20;
+        winner.payee = CScript() << i;
+        {
+            LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+            masternodePayments.mapMasternodePayeeVotes[winner.GetHash()] = winner;
+        }
+
+        // A worker walks the votes for "mnget" while this thread serves one of them to "getdata"
+        CDataStream ssCount(SER_NETWORK, PROTOCOL_VERSION);
+        ssCount << 1000;
+        BOOST_CHECK(messageDispatcher.Push(&node, MakeMessage("mnget", ssCount)));
+
+        CDataStream ssInv(SER_NETWORK, PROTOCOL_VERSION);
+        ssInv << vector<CInv>(1, CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
+        {
+            LOCK(node.cs_vRecvMsg);
+            node.vRecvMsg.push_back(MakeMessage("getdata", ssInv));
+            ProcessMessages(&node);
+        }
+    }
+
+    // Wait for the workers to finish the peer's queue
+    bool fQueued = true;
+    int64_t nStart = GetTimeMillis();
+    while (fQueued && GetTimeMillis() - nStart < 60 * 1000) {
+        MilliSleep(1);
+        LOCK(node.cs_vDispatchMsg);
+        fQueued = node.fDispatchQueued;
+    }
+    BOOST_CHECK(!fQueued);
+    {
+        LOCK(node.cs_vDispatchMsg);
+        BOOST_CHECK(node.vDispatchMsg.empty());
+    }
+
+    CNodeStats stats;
+    node.copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapSendPerMsgType["mnw"].second, 200U);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    BOOST_CHECK(!messageDispatcher.IsActive());
+
+    masternodePayments.Clear();
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "muhash.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "txdb.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(muhash_tests)
+
+static std::vector<unsigned char> Element(unsigned char c)
+{
+    return std::vector<unsigned char>(32, c);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_order_independent)
+{
+    CMuHash3072 a, b;
+    for (unsigned char i = 0; i < 8; i++)
+        a.Insert(Element(i));
+    for (unsigned char i = 8; i > 0; i--)
+        b.Insert(Element(i - 1));
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+
+    b.Insert(Element(8));
+    BOOST_CHECK(a.Finalize() != b.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(muhash_insert_remove)
+{
+    CMuHash3072 empty, set;
+    set.Insert(Element(1));
+    set.Insert(Element(2));
+    BOOST_CHECK(set.Finalize() != empty.Finalize());
+
+    // Removing an element before it is inserted is fine as well
+    set.Remove(Element(3));
+    set.Remove(Element(1));
+    set.Insert(Element(3));
+    set.Remove(Element(2));
+    BOOST_CHECK(set.Finalize() == empty.Finalize());
+
+    CMuHash3072 left, right, both;
+    left.Insert(Element(4));
+    right.Insert(Element(5));
+    both.Insert(Element(5));
+    both.Insert(Element(4));
+    left *= right;
+    BOOST_CHECK(left.Finalize() == both.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(muhash_serialize)
+{
+    CMuHash3072 set;
+    set.Insert(Element(1));
+    set.Remove(Element(2));
+
+    CDataStream ss(SER_DISK, 0);
+    ss << set;
+    CMuHash3072 set2;
+    ss >> set2;
+    BOOST_CHECK(set.Finalize() == set2.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(coinssetstats_running_totals)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 10;
+    coins.vout.resize(2);
+    coins.vout[0].nValue = 1 * COIN;
+    coins.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coins.vout[1].nValue = 2 * COIN;
+    coins.vout[1].scriptPubKey = CScript() << OP_FALSE;
+
+    // A flush creating the entry, then one spending an output of it
+    CCoinsSetStats delta;
+    delta.Update(txid, CCoins(), coins);
+    uint256 hashFirst = GetRandHash();
+    db.QueueStatsUpdate(hashFirst, delta);
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        cache.SetBestBlock(hashFirst);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoins coinsSpent = coins;
+    coinsSpent.Spend(0);
+    CCoinsSetStats deltaSpend;
+    deltaSpend.Update(txid, coins, coinsSpent);
+    uint256 hashSecond = GetRandHash();
+    db.QueueStatsUpdate(hashSecond, deltaSpend);
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coinsSpent;
+        cache.SetBestBlock(hashSecond);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // The totals match those of the remaining set built from scratch
+    CCoinsSetStats expected;
+    expected.Update(txid, CCoins(), coinsSpent);
+    CCoinsStats stats;
+    BOOST_CHECK(db.GetRunningStats(stats));
+    BOOST_CHECK(stats.hashBlock == hashSecond);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 1U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 2 * COIN);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, expected.nSerializedSize);
+    BOOST_CHECK(stats.hashMuHash == expected.muhash.Finalize());
+
+    // A flush whose change was not handed over leaves the totals unknown
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Clear();
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.GetRunningStats(stats));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The ZIJA developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+#include "protocol.h"
+#include "utiltime.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(net_message_type_index)
+{
+    for (unsigned int i = 0; i < NET_MESSAGE_TYPE_COUNT; i++)
+        BOOST_CHECK_EQUAL(GetNetMessageTypeIndex(GetNetMessageTypeName(i)), i);
+    BOOST_CHECK_EQUAL(GetNetMessageTypeIndex("nosuchcmd"), NET_MESSAGE_TYPE_OTHER);
+    BOOST_CHECK_EQUAL(string(GetNetMessageTypeName(NET_MESSAGE_TYPE_OTHER)), "*other*");
+}
+
+BOOST_AUTO_TEST_CASE(net_message_counters)
+{
+    CNetMessageCounters counters;
+    msgtypetraffic_t mapTraffic;
+    counters.GetTraffic(mapTraffic);
+    BOOST_CHECK(mapTraffic.empty());
+
+    counters.Record(GetNetMessageTypeIndex("inv"), 61);
+    counters.Record(GetNetMessageTypeIndex("inv"), 97);
+    counters.Record(GetNetMessageTypeIndex("nosuchcmd"), 24);
+    counters.GetTraffic(mapTraffic);
+    BOOST_CHECK_EQUAL(mapTraffic.size(), 2U);
+    BOOST_CHECK_EQUAL(mapTraffic["inv"].first, 158U);
+    BOOST_CHECK_EQUAL(mapTraffic["inv"].second, 2U);
+    BOOST_CHECK_EQUAL(mapTraffic["*other*"].first, 24U);
+    BOOST_CHECK_EQUAL(mapTraffic["*other*"].second, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(net_upload_target)
+{
+    CNode::SetMaxOutboundTarget(0);
+    CNode::RecordBytesSent(1000);
+    BOOST_CHECK(!CNode::OutboundTargetReached());
+    BOOST_CHECK_EQUAL(CNode::GetOutboundTargetBytesLeft(), 0U);
+    BOOST_CHECK_EQUAL(CNode::GetMaxOutboundTimeLeftInCycle(), 0);
+
+    // Only bytes sent after the target is set count against it
+    CNode::SetMaxOutboundTarget(5000);
+    BOOST_CHECK_EQUAL(CNode::GetOutboundBytesSentInCycle(), 0U);
+    CNode::RecordBytesSent(3000);
+    BOOST_CHECK(!CNode::OutboundTargetReached());
+    BOOST_CHECK_EQUAL(CNode::GetOutboundTargetBytesLeft(), 2000U);
+    BOOST_CHECK(CNode::GetMaxOutboundTimeLeftInCycle() > 0);
+    CNode::RecordBytesSent(2000);
+    BOOST_CHECK(CNode::OutboundTargetReached());
+    BOOST_CHECK_EQUAL(CNode::GetOutboundTargetBytesLeft(), 0U);
+
+    // A new cycle starts from zero
+    SetMockTime(GetTime() + MAX_UPLOAD_TIMEFRAME + 1);
+    BOOST_CHECK(!CNode::OutboundTargetReached());
+    CNode::RecordBytesSent(100);
+    BOOST_CHECK_EQUAL(CNode::GetOutboundBytesSentInCycle(), 100U);
+    SetMockTime(0);
+
+    CNode::SetMaxOutboundTarget(0);
+}
+
+BOOST_AUTO_TEST_CASE(net_inv_queue)
+{
+    CInvQueue queue;
+    vector<CInv> vInv;
+    queue.TakeAll(vInv);
+    BOOST_CHECK(vInv.empty());
+
+    // Taken oldest first and appended behind what is already there
+    vInv.push_back(CInv(MSG_BLOCK, 1));
+    for (int i = 2; i <= 5; i++)
+        queue.Push(CInv(MSG_TX, i));
+    queue.TakeAll(vInv);
+    BOOST_CHECK_EQUAL(vInv.size(), 5U);
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK(vInv[i].hash == uint256(i + 1));
+
+    // Taking empties the queue, entries left behind are freed with it
+    vector<CInv> vInv2;
+    queue.TakeAll(vInv2);
+    BOOST_CHECK(vInv2.empty());
+    queue.Push(CInv(MSG_TX, 6));
+}
+
+BOOST_AUTO_TEST_CASE(net_inventory_known)
+{
+    CRollingBloomFilter filterInventoryKnown(INVENTORY_KNOWN_FILTER_SIZE, INVENTORY_KNOWN_FILTER_FPRATE);
+    filterInventoryKnown.insert(CInv(MSG_TX, 1).GetKey());
+    BOOST_CHECK(filterInventoryKnown.contains(CInv(MSG_TX, 1).GetKey()));
+
+    // A lock request or DSTX for a transaction the peer knows is still news to it
+    BOOST_CHECK(!filterInventoryKnown.contains(CInv(MSG_TXLOCK_REQUEST, 1).GetKey()));
+    BOOST_CHECK(!filterInventoryKnown.contains(CInv(MSG_DSTX, 1).GetKey()));
+    BOOST_CHECK(!filterInventoryKnown.contains(CInv(MSG_TX, 2).GetKey()));
+}
+
+BOOST_AUTO_TEST_CASE(net_poisson_next_send)
+{
+    int64_t nNow = 1000000;
+    int64_t nTotal = 0;
+    for (int i = 0; i < 10000; i++) {
+        int64_t nNext = PoissonNextSend(nNow, 5);
+        BOOST_CHECK(nNext >= nNow);
+        nTotal += nNext - nNow;
+    }
+    // the mean of 10000 draws is well within 10% of 5 seconds
+    BOOST_CHECK(nTotal / 10000 > 4500000 && nTotal / 10000 < 5500000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
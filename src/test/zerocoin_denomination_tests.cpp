@@ -521,4 +521,31 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99)
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(block_index_zerocoin_fields_test)
+{
+    CBlockIndex index;
+    index.nVersion = 4;
+    index.SetZerocoinSupply(ZQ_FIVE, 12);
+    index.SetZerocoinSupply(ZQ_FIVE_THOUSAND, 3);
+    index.AddMint(ZQ_FIVE);
+    index.AddMint(ZQ_FIVE);
+    index.AddMint(ZQ_ONE_HUNDRED);
+
+    BOOST_CHECK_EQUAL(index.GetZerocoinSupply(), 12 * 5 * COIN + 3 * 5000 * COIN);
+    BOOST_CHECK(index.MintedDenomination(ZQ_FIVE));
+    BOOST_CHECK(!index.MintedDenomination(ZQ_TEN));
+    BOOST_CHECK_THROW(index.GetMintCount(ZQ_ERROR), std::out_of_range);
+
+    // The compact fields round trip through the map/vector disk format
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    for (auto& denom : zerocoinDenomList) {
+        BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(denom), index.GetZerocoinSupply(denom));
+        BOOST_CHECK_EQUAL(diskindex.GetMintCount(denom), index.GetMintCount(denom));
+    }
+    BOOST_CHECK_EQUAL(diskindex.GetMintCount(ZQ_FIVE), 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -99,12 +99,20 @@ BOOST_AUTO_TEST_CASE(checkzerocoinmint_test)
     bool fFoundMint = false;
     for(unsigned int i = 0; i < tx.vout.size(); i++){
         if(!tx.vout[i].scriptPubKey.empty() && tx.vout[i].scriptPubKey.IsZerocoinMint()) {
-            BOOST_CHECK(CheckZerocoinMint(tx.GetHash(), tx.vout[i], state, true));
+            BOOST_CHECK(CheckZerocoinMint(tx, i, state, true));
             fFoundMint = true;
         }
     }
 
     BOOST_CHECK(fFoundMint);
+
+    // the checks above parsed the mints once; copies share what was parsed
+    BOOST_CHECK(tx.GetZerocoinCache());
+    CTransaction txCopy(tx);
+    BOOST_CHECK(txCopy.GetZerocoinCache() == tx.GetZerocoinCache());
+    CMutableTransaction txMutable(tx);
+    CTransaction txChanged(txMutable);
+    BOOST_CHECK(!txChanged.GetZerocoinCache());
 }
 
 bool CheckZerocoinSpendNoDB(const CTransaction tx, string& strError)
@@ -429,6 +437,38 @@ BOOST_AUTO_TEST_CASE(setup_exceptions_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(accumulator_value_cache)
+{
+    CAccumulatorValueCache cache(3);
+    CBigNum bnValue;
+    BOOST_CHECK(!cache.Get(1, bnValue));
+
+    cache.Insert(1, CBigNum(100));
+    cache.Insert(2, CBigNum(200));
+    cache.Insert(3, CBigNum(300));
+    BOOST_CHECK(cache.Get(1, bnValue));
+    BOOST_CHECK(bnValue == CBigNum(100));
+
+    // 2 is now the least recently used
+    cache.Insert(4, CBigNum(400));
+    BOOST_CHECK(!cache.Get(2, bnValue));
+    BOOST_CHECK(cache.Get(1, bnValue));
+    BOOST_CHECK(cache.Get(3, bnValue));
+    BOOST_CHECK(cache.Get(4, bnValue));
+
+    cache.Erase(3);
+    BOOST_CHECK(!cache.Get(3, bnValue));
+    cache.SetMaxEntries(1);
+    BOOST_CHECK(cache.Get(4, bnValue));
+    BOOST_CHECK(!cache.Get(1, bnValue));
+
+    CAccumulatorCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 5U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 4U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 2U);
+}
+
 BOOST_AUTO_TEST_CASE(checksum_tests)
 {
     cout << "Running checksum_tests\n";
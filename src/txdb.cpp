@@ -12,6 +12,7 @@
 #include "pow.h"
 #include "uint256.h"
 #include "accumulators.h"
+#include "random.h"
 
 #include <stdint.h>
 
@@ -33,8 +34,75 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+namespace
 {
+/** Serialize a single unspent output as a MuHash set element */
+std::vector<unsigned char> CoinSetElement(const uint256& txid, const CCoins& coins, unsigned int n)
+{
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << txid;
+    ss << VARINT(n);
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    ss << coins.vout[n];
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+uint64_t CoinsDiskSize(const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return 0;
+    return 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+} // anonymous namespace
+
+void CCoinsSetStats::Update(const uint256& txid, const CCoins& coinsOld, const CCoins& coinsNew)
+{
+    // Outputs that are unchanged between both versions of the entry (the
+    // common case of a partially spent transaction) need no hashing at all.
+    bool fSameMeta = coinsOld.nVersion == coinsNew.nVersion && coinsOld.nHeight == coinsNew.nHeight &&
+                     coinsOld.fCoinBase == coinsNew.fCoinBase;
+
+    for (unsigned int i = 0; i < coinsOld.vout.size(); i++) {
+        const CTxOut& out = coinsOld.vout[i];
+        if (out.IsNull() || (fSameMeta && i < coinsNew.vout.size() && coinsNew.vout[i] == out))
+            continue;
+        muhash.Remove(CoinSetElement(txid, coinsOld, i));
+        nTransactionOutputs--;
+        nTotalAmount -= out.nValue;
+    }
+    for (unsigned int i = 0; i < coinsNew.vout.size(); i++) {
+        const CTxOut& out = coinsNew.vout[i];
+        if (out.IsNull() || (fSameMeta && i < coinsOld.vout.size() && coinsOld.vout[i] == out))
+            continue;
+        muhash.Insert(CoinSetElement(txid, coinsNew, i));
+        nTransactionOutputs++;
+        nTotalAmount += out.nValue;
+    }
+
+    if (!coinsOld.IsPruned())
+        nTransactions--;
+    if (!coinsNew.IsPruned())
+        nTransactions++;
+    nSerializedSize = nSerializedSize - CoinsDiskSize(coinsOld) + CoinsDiskSize(coinsNew);
+}
+
+void CCoinsSetStats::Add(const CCoinsSetStats& delta)
+{
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nSerializedSize += delta.nSerializedSize;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, CLevelDBOptions("chainstate")), fSetStats(false)
+{
+    if (db.Read('S', setStats))
+        fSetStats = true;
+    else if (!db.Exists('B'))
+        fSetStats = true; // brand new chainstate, the empty set is trivially tracked
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
@@ -47,6 +115,22 @@ bool CCoinsViewDB::HaveCoins(const uint256& txid) const
     return db.Exists(make_pair('c', txid));
 }
 
+void CCoinsViewDB::GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const
+{
+    std::vector<std::pair<char, uint256> > vKeys;
+    vKeys.reserve(vTxid.size());
+    BOOST_FOREACH (const uint256& txid, vTxid)
+        vKeys.push_back(make_pair('c', txid));
+
+    std::vector<std::pair<std::pair<char, uint256>, CCoins> > vFound;
+    db.ReadBatch(vKeys, vFound);
+    vCoins.reserve(vCoins.size() + vFound.size());
+    for (size_t i = 0; i < vFound.size(); i++) {
+        vCoins.push_back(std::make_pair(vFound[i].first.second, CCoins()));
+        vCoins.back().second.swap(vFound[i].second);
+    }
+}
+
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
@@ -60,23 +144,210 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    // The entries are left in place: CCoinsViewWriteBehind keeps serving
+    // reads from the map while it is being written.
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
+    // Flushes are written in the order their changes to the totals were
+    // queued. A write without one leaves the totals unknown until the next
+    // full scan rather than wrong.
+    CCoinsSetStats setStatsNew = setStats;
+    bool fSetStatsNew = false;
+    {
+        LOCK(cs_statsQueued);
+        if (!dequeStatsQueued.empty() && dequeStatsQueued.front().first == hashBlock) {
+            setStatsNew.Add(dequeStatsQueued.front().second);
+            fSetStatsNew = fSetStats;
+            dequeStatsQueued.pop_front();
+        }
+    }
+    if (fSetStatsNew)
+        batch.Write('S', setStatsNew);
+    else if (fSetStats)
+        batch.Erase('S');
+
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+    setStats = setStatsNew;
+    fSetStats = fSetStatsNew;
+    return true;
+}
+
+void CCoinsViewDB::QueueStatsUpdate(const uint256& hashBlock, const CCoinsSetStats& delta)
+{
+    LOCK(cs_statsQueued);
+    dequeStatsQueued.push_back(std::make_pair(hashBlock, delta));
+}
+
+CCoinsViewWriteBehind::CCoinsViewWriteBehind(CCoinsView* viewIn, CBlockTreeDB* pblocktreeIn) : CCoinsViewBacked(viewIn),
+                                                                                            pblocktreeWrite(pblocktreeIn),
+                                                                                            hashWriting(0),
+                                                                                            fWriting(false),
+                                                                                            fFailed(false),
+                                                                                            fStop(false)
+{
+    threadWriter = boost::thread(&CCoinsViewWriteBehind::ThreadWrite, this);
+}
+
+CCoinsViewWriteBehind::~CCoinsViewWriteBehind()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+    }
+    condWriter.notify_one();
+    threadWriter.join();
+}
+
+void CCoinsViewWriteBehind::ThreadWrite()
+{
+    RenameThread("zija-coinwriter");
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (!fWriting && !fStop)
+            condWriter.wait(lock);
+        if (!fWriting)
+            break; // stop requested and nothing left to write
+
+        uint256 hashBlock = hashWriting;
+        lock.unlock();
+
+        // mapWriting is not modified while fWriting is set, so it can be read
+        // without the lock, and the base only reads the map it is given.
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = (updateWriting.IsEmpty() || pblocktreeWrite->WriteBlockTreeUpdate(updateWriting)) &&
+                  base->BatchWrite(mapWriting, hashBlock);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "%s : wrote %u block index entries and coins up to %s in %.2fms\n", __func__,
+            updateWriting.vBlockIndex.size(), hashBlock.ToString(), 0.001 * (GetTimeMicros() - nStart));
+
+        lock.lock();
+        if (fOk) {
+            mapWriting.clear();
+            updateWriting.Clear();
+        } else {
+            // keep serving the unwritten entries, the node is going down
+            fFailed = true;
+        }
+        fWriting = false;
+        condIdle.notify_all();
+
+        if (!fOk) {
+            lock.unlock();
+            AbortNode("Failed to write to coin database");
+            return;
+        }
+    }
+}
+
+bool CCoinsViewWriteBehind::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapWriting.find(txid);
+        if (it != mapWriting.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewWriteBehind::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapWriting.find(txid);
+        if (it != mapWriting.end())
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+void CCoinsViewWriteBehind::GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const
+{
+    std::vector<uint256> vMissing;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        for (const uint256& txid : vTxid) {
+            CCoinsMap::const_iterator it = mapWriting.find(txid);
+            if (it != mapWriting.end())
+                vCoins.push_back(std::make_pair(txid, it->second.coins));
+            else
+                vMissing.push_back(txid);
+        }
+    }
+    if (!vMissing.empty())
+        base->GetCoinsBatch(vMissing, vCoins);
+}
+
+uint256 CCoinsViewWriteBehind::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if ((fWriting || fFailed) && hashWriting != 0)
+            return hashWriting;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewWriteBehind::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (fWriting)
+        condIdle.wait(lock);
+    if (fFailed)
+        return false;
+
+    mapWriting.swap(mapCoins);
+    mapCoins.clear();
+    hashWriting = hashBlock;
+    std::swap(updateWriting, updateQueued);
+    updateQueued.Clear();
+    fWriting = true;
+    condWriter.notify_one();
+    return true;
+}
+
+bool CCoinsViewWriteBehind::GetStats(CCoinsStats& stats) const
+{
+    return WaitForWrites() && base->GetStats(stats);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+bool CCoinsViewWriteBehind::GetRunningStats(CCoinsStats& stats) const
+{
+    return WaitForWrites() && base->GetRunningStats(stats);
+}
+
+void CCoinsViewWriteBehind::QueueBlockTreeUpdate(const CBlockTreeUpdate& update)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    updateQueued.Merge(update);
+}
+
+bool CCoinsViewWriteBehind::WaitForWrites() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (fWriting)
+        condIdle.wait(lock);
+    return !fFailed;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, CLevelDBOptions("blockindex"))
 {
 }
 
@@ -85,6 +356,34 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+void CBlockTreeUpdate::Merge(const CBlockTreeUpdate& other)
+{
+    // Entries are written in order, so a later copy of the same key wins
+    vFileInfo.insert(vFileInfo.end(), other.vFileInfo.begin(), other.vFileInfo.end());
+    vBlockIndex.insert(vBlockIndex.end(), other.vBlockIndex.begin(), other.vBlockIndex.end());
+    if (other.nLastBlockFile >= 0)
+        nLastBlockFile = other.nLastBlockFile;
+}
+
+void CBlockTreeUpdate::Clear()
+{
+    vFileInfo.clear();
+    nLastBlockFile = -1;
+    vBlockIndex.clear();
+}
+
+bool CBlockTreeDB::WriteBlockTreeUpdate(const CBlockTreeUpdate& update)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<int, CBlockFileInfo> >::const_iterator it = update.vFileInfo.begin(); it != update.vFileInfo.end(); it++)
+        batch.Write(make_pair('f', it->first), it->second);
+    if (update.nLastBlockFile >= 0)
+        batch.Write('l', update.nLastBlockFile);
+    for (std::vector<CDiskBlockIndex>::const_iterator it = update.vBlockIndex.begin(); it != update.vBlockIndex.end(); it++)
+        batch.Write(make_pair('b', it->GetBlockHash()), *it);
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::WriteBlockFileInfo(int nFile, const CBlockFileInfo& info)
 {
     return Write(make_pair('f', nFile), info);
@@ -131,6 +430,7 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    CCoinsSetStats setStatsScan;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -161,6 +461,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 }
                 stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
+                if (!fSetStats)
+                    setStatsScan.Update(txhash, CCoins(), coins);
             }
             pcursor->Next();
         } catch (std::exception& e) {
@@ -170,6 +472,31 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
+
+    if (!fSetStats) {
+        // First scan of a chainstate without running totals: seed them in
+        // memory, the next flush stores them along with its changes.
+        setStats = setStatsScan;
+        fSetStats = true;
+        LogPrintf("%s : initialized coin set statistics at block %s\n", __func__, stats.hashBlock.ToString());
+    }
+    stats.hashMuHash = setStats.muhash.Finalize();
+    return true;
+}
+
+bool CCoinsViewDB::GetRunningStats(CCoinsStats& stats) const
+{
+    if (!fSetStats)
+        return false;
+
+    stats.hashBlock = GetBestBlock();
+    BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+    stats.nHeight = mi == mapBlockIndex.end() ? 0 : mi->second->nHeight;
+    stats.nTransactions = setStats.nTransactions;
+    stats.nTransactionOutputs = setStats.nTransactionOutputs;
+    stats.nSerializedSize = setStats.nSerializedSize;
+    stats.nTotalAmount = setStats.nTotalAmount;
+    stats.hashMuHash = setStats.muhash.Finalize();
     return true;
 }
 
@@ -186,6 +513,16 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadBlockStats(const uint256& hashBlock, CBlockStats& stats)
+{
+    return Read(make_pair('S', hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats)
+{
+    return Write(make_pair('S', hashBlock), stats);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -210,6 +547,50 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+namespace
+{
+//! Number of block index entries read from the database before they are decoded in parallel
+const size_t BLOCK_INDEX_LOAD_CHUNK = 32768;
+//! Maximum number of threads decoding block index entries at startup
+const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+
+struct CBlockIndexLoadEntry {
+    uint256 hash;
+    std::string strValue;
+    CDiskBlockIndex diskindex;
+    bool fValid;
+};
+
+void DecodeBlockIndexEntries(std::vector<CBlockIndexLoadEntry>* pvEntries, size_t nOffset, size_t nStride)
+{
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    for (size_t i = nOffset; i < pvEntries->size(); i += nStride) {
+        CBlockIndexLoadEntry& entry = (*pvEntries)[i];
+        entry.fValid = false;
+        try {
+            ssValue.clear();
+            ssValue.write(entry.strValue.data(), entry.strValue.size());
+            ssValue >> entry.diskindex;
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            continue;
+        }
+        std::string().swap(entry.strValue);
+
+        // The proof of work check below is only meaningful for the hash of the stored header
+        if (entry.diskindex.GetBlockHash() != entry.hash) {
+            LogPrintf("%s : block index entry %s does not match its header\n", __func__, entry.hash.ToString());
+            continue;
+        }
+        if (entry.diskindex.nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(entry.hash, entry.diskindex.nBits)) {
+            LogPrintf("%s : CheckProofOfWork failed: %s\n", __func__, entry.hash.ToString());
+            continue;
+        }
+        entry.fValid = true;
+    }
+}
+} // anonymous namespace
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -218,97 +599,231 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
+    // Size the index for the number of entries seen on the previous startup
+    int nIndexSizeHint = 0;
+    if (ReadInt("blockindexsize", nIndexSizeHint) && nIndexSizeHint > 0)
+        mapBlockIndex.reserve(nIndexSizeHint);
+
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS));
+
     // Load mapBlockIndex
     uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
+    std::vector<CBlockIndexLoadEntry> vEntries;
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+
+        // Read a chunk of raw entries in key order
+        vEntries.clear();
+        vEntries.reserve(BLOCK_INDEX_LOAD_CHUNK);
+        while (vEntries.size() < BLOCK_INDEX_LOAD_CHUNK) {
+            if (!pcursor->Valid()) {
+                fDone = true;
+                break;
+            }
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true; // finished loading block index
+                    break;
                 }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+                vEntries.push_back(CBlockIndexLoadEntry());
+                ssKey >> vEntries.back().hash;
+                leveldb::Slice slValue = pcursor->value();
+                vEntries.back().strValue.assign(slValue.data(), slValue.size());
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+            pcursor->Next();
+        }
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zpiv. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
+        // Decode and check the chunk in parallel
+        boost::thread_group decodeThreads;
+        for (int i = 0; i < nThreads; i++)
+            decodeThreads.create_thread(boost::bind(&DecodeBlockIndexEntries, &vEntries, i, nThreads));
+        decodeThreads.join_all();
 
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+        for (const CBlockIndexLoadEntry& entry : vEntries) {
+            if (!entry.fValid)
+                return error("LoadBlockIndex() : failed to load block index entry %s", entry.hash.ToString());
+            const CDiskBlockIndex& diskindex = entry.diskindex;
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(entry.hash);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->nZerocoinSupply = diskindex.nZerocoinSupply;
+            pindexNew->nMintsInBlock = diskindex.nMintsInBlock;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+            //note accumulator checkpoints missing from the database, their values are loaded on demand
+            if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
+                //Don't check any checkpoints that exist before v2 zpiv. The accumulator is invalid for v1 and not used.
+                if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
+                    HaveAccumulatorValuesInDB(pindexNew->nAccumulatorCheckpoint);
+
+                nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
             }
-        } catch (std::exception& e) {
+        }
+    }
+
+    WriteInt("blockindexsize", (int)mapBlockIndex.size());
+
+    return true;
+}
+
+//! filters are sized for twice the entries present when they are built, but at least this many
+static const unsigned int ZEROCOIN_FILTER_MIN_ELEMENTS = 100000;
+
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe, CLevelDBOptions("zerocoin"))
+{
+    mapFilter['s'];
+    mapFilter['m'];
+}
+
+bool CZerocoinDB::LoadFilters()
+{
+    LOCK(cs_filterWrite);
+    return LoadFilter('s') && LoadFilter('m');
+}
+
+bool CZerocoinDB::LoadFilter(char chType)
+{
+    AssertLockHeld(cs_filterWrite);
+    int64_t nStart = GetTimeMillis();
+
+    std::vector<uint256> vHash;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(chType, uint256(0));
+    pcursor->Seek(ssKeySet.str());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chKeyType;
+            ssKey >> chKeyType;
+            if (chKeyType != chType)
+                break;
+            uint256 hash;
+            ssKey >> hash;
+            vHash.push_back(hash);
+        } catch (const std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
 
+    std::unique_ptr<CHashBloomFilter> filter(new CHashBloomFilter(std::max((unsigned int)vHash.size() * 2, ZEROCOIN_FILTER_MIN_ELEMENTS), GetRand(std::numeric_limits<uint64_t>::max())));
+    for (const uint256& hash : vHash)
+        filter->insert(hash);
+
+    LOCK(cs_filter);
+    CHashFilter& entry = mapFilter[chType];
+    entry.filter.swap(filter);
+    entry.stats.fLoaded = true;
+    LogPrint("zero", "%s: %u entries of type %c in %dms\n", __func__, vHash.size(), chType, GetTimeMillis() - nStart);
     return true;
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+bool CZerocoinDB::MayContain(char chType, const uint256& hash) const
 {
+    LOCK(cs_filter);
+    CHashFilter& entry = mapFilter[chType];
+    if (!entry.filter)
+        return true;
+    entry.stats.nLookups++;
+    if (entry.filter->contains(hash))
+        return true;
+    entry.stats.nFiltered++;
+    return false;
 }
 
-bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
+void CZerocoinDB::FilterMissed(char chType, unsigned int nMissed) const
+{
+    LOCK(cs_filter);
+    CHashFilter& entry = mapFilter[chType];
+    if (entry.filter)
+        entry.stats.nFalsePositives += nMissed;
+}
+
+CZerocoinFilterStats CZerocoinDB::GetFilterStats(char chType) const
+{
+    LOCK(cs_filter);
+    const CHashFilter& entry = mapFilter[chType];
+    CZerocoinFilterStats stats = entry.stats;
+    if (entry.filter) {
+        stats.nEntries = entry.filter->GetInserted();
+        stats.nCapacity = entry.filter->GetCapacity();
+        stats.nMemoryUsage = entry.filter->GetMemoryUsage();
+    }
+    return stats;
+}
+
+bool CZerocoinDB::WriteHashBatch(char chType, const std::vector<uint256>& vHash, const std::vector<uint256>& vTxHash)
 {
+    LOCK(cs_filterWrite);
+    bool fRebuild = false;
+    {
+        // the filter must know about an entry before any reader can find it in the database
+        LOCK(cs_filter);
+        CHashFilter& entry = mapFilter[chType];
+        if (entry.filter) {
+            for (const uint256& hash : vHash)
+                entry.filter->insert(hash);
+            fRebuild = entry.filter->IsOverfull();
+        }
+    }
+
     CLevelDBBatch batch;
-    size_t count = 0;
+    for (unsigned int i = 0; i < vHash.size(); i++)
+        batch.Write(make_pair(chType, vHash[i]), vTxHash[i]);
+    if (!WriteBatch(batch, true))
+        return false;
+
+    if (fRebuild)
+        LoadFilter(chType);
+    return true;
+}
+
+bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
+{
+    std::vector<uint256> vHash, vTxHash;
     for (std::vector<std::pair<libzerocoin::PublicCoin, uint256> >::const_iterator it=mintInfo.begin(); it != mintInfo.end(); it++) {
-        PublicCoin pubCoin = it->first;
-        uint256 hash = GetPubCoinHash(pubCoin.getValue());
-        batch.Write(make_pair('m', hash), it->second);
-        ++count;
+        vHash.push_back(GetPubCoinHash(it->first.getValue()));
+        vTxHash.push_back(it->second);
     }
 
-    LogPrint("zero", "Writing %u coin mints to db.\n", (unsigned int)count);
-    return WriteBatch(batch, true);
+    LogPrint("zero", "Writing %u coin mints to db.\n", (unsigned int)vHash.size());
+    return WriteHashBatch('m', vHash, vTxHash);
 }
 
 bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
@@ -318,7 +833,12 @@ bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
 
 bool CZerocoinDB::ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx)
 {
-    return Read(make_pair('m', hashPubcoin), hashTx);
+    if (!MayContain('m', hashPubcoin))
+        return false;
+    if (Read(make_pair('m', hashPubcoin), hashTx))
+        return true;
+    FilterMissed('m', 1);
+    return false;
 }
 
 bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
@@ -329,19 +849,17 @@ bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
 
 bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo)
 {
-    CLevelDBBatch batch;
-    size_t count = 0;
+    std::vector<uint256> vHash, vTxHash;
     for (std::vector<std::pair<libzerocoin::CoinSpend, uint256> >::const_iterator it=spendInfo.begin(); it != spendInfo.end(); it++) {
         CBigNum bnSerial = it->first.getCoinSerialNumber();
         CDataStream ss(SER_GETHASH, 0);
         ss << bnSerial;
-        uint256 hash = Hash(ss.begin(), ss.end());
-        batch.Write(make_pair('s', hash), it->second);
-        ++count;
+        vHash.push_back(Hash(ss.begin(), ss.end()));
+        vTxHash.push_back(it->second);
     }
 
-    LogPrint("zero", "Writing %u coin spends to db.\n", (unsigned int)count);
-    return WriteBatch(batch, true);
+    LogPrint("zero", "Writing %u coin spends to db.\n", (unsigned int)vHash.size());
+    return WriteHashBatch('s', vHash, vTxHash);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
@@ -350,12 +868,45 @@ bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Read(make_pair('s', hash), txHash);
+    return ReadCoinSpend(hash, txHash);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const uint256& hashSerial, uint256 &txHash)
 {
-    return Read(make_pair('s', hashSerial), txHash);
+    if (!MayContain('s', hashSerial))
+        return false;
+    if (Read(make_pair('s', hashSerial), txHash))
+        return true;
+    FilterMissed('s', 1);
+    return false;
+}
+
+void CZerocoinDB::ReadCoinMintBatch(const std::vector<uint256>& vHashPubcoin, std::map<uint256, uint256>& mapTxHash)
+{
+    ReadHashBatch('m', vHashPubcoin, mapTxHash);
+}
+
+void CZerocoinDB::ReadCoinSpendBatch(const std::vector<uint256>& vHashSerial, std::map<uint256, uint256>& mapTxHash)
+{
+    ReadHashBatch('s', vHashSerial, mapTxHash);
+}
+
+void CZerocoinDB::ReadHashBatch(char chType, const std::vector<uint256>& vHash, std::map<uint256, uint256>& mapTxHash)
+{
+    std::vector<std::pair<char, uint256> > vKeys;
+    vKeys.reserve(vHash.size());
+    for (const uint256& hash : vHash) {
+        if (MayContain(chType, hash))
+            vKeys.push_back(make_pair(chType, hash));
+    }
+
+    std::vector<std::pair<std::pair<char, uint256>, uint256> > vFound;
+    if (!vKeys.empty())
+        ReadBatch(vKeys, vFound);
+    FilterMissed(chType, vKeys.size() - vFound.size());
+    for (const auto& found : vFound)
+        mapTxHash[found.first.second] = found.second;
+    LogPrint("zero", "%s: found %u of %u entries of type %c\n", __func__, vFound.size(), vHash.size(), chType);
 }
 
 bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
@@ -407,6 +958,10 @@ bool CZerocoinDB::WipeCoins(std::string strType)
             LogPrintf("%s: error failed to delete %s\n", __func__, hash.GetHex());
     }
 
+    // drop the wiped hashes from the filter unless it was never loaded
+    LOCK(cs_filterWrite);
+    if (GetFilterStats(type).fLoaded)
+        return LoadFilter(type);
     return true;
 }
 
@@ -421,8 +976,55 @@ bool CZerocoinDB::ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnVal
     return Read(make_pair('2', nChecksum), bnValue);
 }
 
+bool CZerocoinDB::HaveAccumulatorValue(const uint32_t& nChecksum)
+{
+    return Exists(make_pair('2', nChecksum));
+}
+
 bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
 {
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(make_pair('2', nChecksum));
 }
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blockfilter", nCacheSize, fMemory, fWipe, CLevelDBOptions("blockfilter"))
+{
+}
+
+bool CBlockFilterDB::WriteFilter(const BlockFilter& filter, const uint256& header)
+{
+    // Filters are kept per block hash, so the ones of a disconnected branch stay valid for it
+    CLevelDBBatch batch;
+    batch.Write(make_pair('f', filter.GetBlockHash()), filter.GetEncodedFilter());
+    batch.Write(make_pair('h', filter.GetBlockHash()), make_pair(filter.GetHash(), header));
+    return WriteBatch(batch);
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, BlockFilter& filter)
+{
+    std::vector<unsigned char> vEncoded;
+    if (!Read(make_pair('f', hashBlock), vEncoded))
+        return false;
+    try {
+        filter = BlockFilter(BASIC_FILTER, hashBlock, vEncoded);
+    } catch (const std::exception& e) {
+        return error("%s : malformed filter for block %s: %s", __func__, hashBlock.ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterDB::ReadFilterHashAndHeader(const uint256& hashBlock, uint256& hashFilter, uint256& header)
+{
+    std::pair<uint256, uint256> entry;
+    if (!Read(make_pair('h', hashBlock), entry))
+        return false;
+    hashFilter = entry.first;
+    header = entry.second;
+    return true;
+}
+
+bool CBlockFilterDB::ReadFilterHeader(const uint256& hashBlock, uint256& header)
+{
+    uint256 hashFilter;
+    return ReadFilterHashAndHeader(hashBlock, hashFilter, header);
+}
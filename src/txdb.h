@@ -9,15 +9,25 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockfilter.h"
+#include "bloom.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "muhash.h"
 #include "primitives/zerocoin.h"
+#include "sync.h"
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class CCoins;
 class uint256;
 
@@ -27,6 +37,47 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -asyncflush default
+static const bool DEFAULT_ASYNC_FLUSH = true;
+//! -zerocoinfilter default
+static const bool DEFAULT_ZEROCOIN_FILTER = true;
+
+/**
+ * Totals of the unspent output set. Validation collects how each block
+ * changes them (starting from an empty object, the fields then hold the
+ * difference); CCoinsViewDB::BatchWrite adds the change up to the flushed
+ * block and stores the result in the same batch as the best block, so they
+ * never go out of sync.
+ */
+class CCoinsSetStats
+{
+public:
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    CMuHash3072 muhash;
+
+    CCoinsSetStats() : nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    /** Account for the entry of txid changing from coinsOld to coinsNew */
+    void Update(const uint256& txid, const CCoins& coinsOld, const CCoins& coinsNew);
+
+    /** Apply a change collected with Update() on an empty object */
+    void Add(const CCoinsSetStats& delta);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -34,14 +85,42 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CLevelDBWrapper db;
 
+    //! Running totals; only valid while fSetStats is true. A chainstate
+    //! created by an older version gets them from its first full GetStats scan.
+    mutable CCoinsSetStats setStats;
+    mutable bool fSetStats;
+
+    //! Changes to the totals handed over for flushes not written yet, oldest first
+    CCriticalSection cs_statsQueued;
+    std::deque<std::pair<uint256, CCoinsSetStats> > dequeStatsQueued;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
+    void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetRunningStats(CCoinsStats& stats) const;
+
+    //! Have the change to the totals up to hashBlock stored with the flush of that block
+    void QueueStatsUpdate(const uint256& hashBlock, const CCoinsSetStats& delta);
+};
+
+/** Block file information and block index entries to be written as one synced batch */
+struct CBlockTreeUpdate {
+    std::vector<std::pair<int, CBlockFileInfo> > vFileInfo;
+    //! -1 if the last block file did not change
+    int nLastBlockFile;
+    std::vector<CDiskBlockIndex> vBlockIndex;
+
+    CBlockTreeUpdate() : nLastBlockFile(-1) {}
+
+    bool IsEmpty() const { return vFileInfo.empty() && nLastBlockFile < 0 && vBlockIndex.empty(); }
+    void Merge(const CBlockTreeUpdate& other);
+    void Clear();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -56,6 +135,7 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool WriteBlockTreeUpdate(const CBlockTreeUpdate& update);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool WriteBlockFileInfo(int nFile, const CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
@@ -64,6 +144,8 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadBlockStats(const uint256& hashBlock, CBlockStats& stats);
+    bool WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -71,6 +153,77 @@ public:
     bool LoadBlockIndexGuts();
 };
 
+/**
+ * CCoinsView that takes over the contents of a flushed cache and writes them
+ * to its base on a background thread, so that flushing pcoinsTip does not
+ * stall validation. The entries stay readable here until they are on disk.
+ *
+ * Every write first stores the block tree update queued with it (synced),
+ * then the coins together with the best block marker in one batch, so the
+ * databases on disk always match some completed flush. At most one write is
+ * in flight; a second flush waits for it.
+ *
+ * The base is handed the flushed map itself and must leave it unchanged, as
+ * CCoinsViewDB does, since reads keep being served from it during the write.
+ */
+class CCoinsViewWriteBehind : public CCoinsViewBacked
+{
+private:
+    CBlockTreeDB* pblocktreeWrite;
+
+    mutable boost::mutex cs;
+    boost::condition_variable condWriter;
+    mutable boost::condition_variable condIdle;
+
+    //! Entries handed over by the last flush; only modified while !fWriting
+    CCoinsMap mapWriting;
+    uint256 hashWriting;
+    CBlockTreeUpdate updateWriting;
+    //! Block tree changes waiting for the next flush
+    CBlockTreeUpdate updateQueued;
+    bool fWriting;
+    bool fFailed;
+    bool fStop;
+
+    boost::thread threadWriter;
+
+    void ThreadWrite();
+
+public:
+    CCoinsViewWriteBehind(CCoinsView* viewIn, CBlockTreeDB* pblocktreeIn);
+    ~CCoinsViewWriteBehind();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    void GetCoinsBatch(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vCoins) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+    bool GetRunningStats(CCoinsStats& stats) const;
+
+    //! Have the block tree changes written ahead of the next coins flush
+    void QueueBlockTreeUpdate(const CBlockTreeUpdate& update);
+
+    //! Block until no write is in flight; false if a background write failed
+    bool WaitForWrites() const;
+};
+
+/** State and hit counters of the in-memory filter over one kind of zerocoin DB entry */
+struct CZerocoinFilterStats {
+    bool fLoaded;
+    unsigned int nEntries;
+    unsigned int nCapacity;
+    size_t nMemoryUsage;
+    //! lookups that consulted the filter
+    uint64_t nLookups;
+    //! lookups answered "not present" without reading the database
+    uint64_t nFiltered;
+    //! lookups the filter passed on that the database did not have either
+    uint64_t nFalsePositives;
+
+    CZerocoinFilterStats() : fLoaded(false), nEntries(0), nCapacity(0), nMemoryUsage(0), nLookups(0), nFiltered(0), nFalsePositives(0) {}
+};
+
 /** Zerocoin database (zerocoin/) */
 class CZerocoinDB : public CLevelDBWrapper
 {
@@ -81,7 +234,33 @@ private:
     CZerocoinDB(const CZerocoinDB&);
     void operator=(const CZerocoinDB&);
 
+    /**
+     * Almost every serial or pubcoin looked up is not in the database, so a
+     * bloom filter over all stored serial ('s') and pubcoin ('m') hashes
+     * answers those lookups without a disk read. Hashes are added before they
+     * are written and never removed, so the filter has no false negatives;
+     * erased entries just become false positives until the next rebuild.
+     */
+    struct CHashFilter {
+        std::unique_ptr<CHashBloomFilter> filter; //!< NULL while not loaded
+        CZerocoinFilterStats stats;
+    };
+    mutable CCriticalSection cs_filter;
+    mutable std::map<char, CHashFilter> mapFilter;
+    //! serializes writers with filter rebuilds, so a rebuild never misses a pending write
+    CCriticalSection cs_filterWrite;
+
+    bool LoadFilter(char chType);
+    bool MayContain(char chType, const uint256& hash) const;
+    void FilterMissed(char chType, unsigned int nMissed) const;
+    bool WriteHashBatch(char chType, const std::vector<uint256>& vHash, const std::vector<uint256>& vTxHash);
+    void ReadHashBatch(char chType, const std::vector<uint256>& vHash, std::map<uint256, uint256>& mapTxHash);
+
 public:
+    /** Build the serial and pubcoin filters from the database contents */
+    bool LoadFilters();
+    CZerocoinFilterStats GetFilterStats(char chType) const;
+
     /** Write zZIJA mints to the zerocoinDB in a batch */
     bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo);
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
@@ -90,12 +269,34 @@ public:
     bool WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
+    /** Look up many pubcoin or serial hashes at once, found entries are returned in mapTxHash */
+    void ReadCoinMintBatch(const std::vector<uint256>& vHashPubcoin, std::map<uint256, uint256>& mapTxHash);
+    void ReadCoinSpendBatch(const std::vector<uint256>& vHashSerial, std::map<uint256, uint256>& mapTxHash);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(std::string strType);
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
+    bool HaveAccumulatorValue(const uint32_t& nChecksum);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
 };
 
+/** Access to the basic block filters served to light clients (blockfilter/) */
+class CBlockFilterDB : public CLevelDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+
+public:
+    /** Store a filter together with its hash and filter header */
+    bool WriteFilter(const BlockFilter& filter, const uint256& header);
+    bool ReadFilter(const uint256& hashBlock, BlockFilter& filter);
+    bool ReadFilterHashAndHeader(const uint256& hashBlock, uint256& hashFilter, uint256& header);
+    bool ReadFilterHeader(const uint256& hashBlock, uint256& header);
+};
+
 #endif // BITCOIN_TXDB_H
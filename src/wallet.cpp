@@ -11,7 +11,9 @@
 #include "accumulators.h"
 #include "base58.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
+#include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
 #include "net.h"
@@ -34,6 +36,7 @@
 #include <assert.h>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -1425,10 +1428,165 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+namespace
+{
+/**
+ * Prefilter over the wallet's keys, scripts and outpoints used by the
+ * rescan workers to skip transactions that cannot involve the wallet. It
+ * matches the data pushes, outpoints and txids the way a bloom filter
+ * would, but exactly, so it stays selective however large the wallet is.
+ * Candidates are confirmed by AddToWalletIfInvolvingMe under cs_wallet.
+ */
+class CWalletRescanFilter
+{
+private:
+    std::set<std::vector<unsigned char> > setData;
+    std::set<COutPoint> setOutPoints;
+    std::set<uint256> setHashes;
+    bool fMatchAll;
+
+    bool ContainsData(const CScript& script) const
+    {
+        CScript::const_iterator pc = script.begin();
+        std::vector<unsigned char> data;
+        opcodetype opcode;
+        while (pc < script.end() && script.GetOp(pc, opcode, data)) {
+            if (!data.empty() && setData.count(data))
+                return true;
+        }
+        return false;
+    }
+
+public:
+    CWalletRescanFilter() : fMatchAll(false) {}
+
+    void insert(const std::vector<unsigned char>& vData) { setData.insert(vData); }
+    void insert(const COutPoint& outpoint) { setOutPoints.insert(outpoint); }
+    void insert(const uint256& hash) { setHashes.insert(hash); }
+
+    void InsertScript(const CScript& script)
+    {
+        bool fHasData = false;
+        CScript::const_iterator pc = script.begin();
+        std::vector<unsigned char> data;
+        opcodetype opcode;
+        while (pc < script.end() && script.GetOp(pc, opcode, data)) {
+            if (!data.empty()) {
+                setData.insert(data);
+                fHasData = true;
+            }
+        }
+        // Scripts without pushed data cannot be recognised by the filter
+        if (!fHasData)
+            fMatchAll = true;
+    }
+
+    bool IsCandidate(const CTransaction& tx) const
+    {
+        if (fMatchAll || tx.ContainsZerocoins() || setHashes.count(tx.GetHash()))
+            return true;
+        BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+            if (ContainsData(txout.scriptPubKey))
+                return true;
+        }
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            if (setOutPoints.count(txin.prevout) || ContainsData(txin.scriptSig))
+                return true;
+        }
+        return false;
+    }
+};
+
+/** A block read ahead of the rescan together with its candidate transactions */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    std::vector<bool> vCandidate;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+};
+
+/** Read one block of a rescan batch and match it against the filter, as a job for the prefetch workers */
+class CRescanPrefetchJob
+{
+private:
+    CRescanBlock* prescanBlock;
+    const CWalletRescanFilter* pfilter;
+
+public:
+    CRescanPrefetchJob() : prescanBlock(NULL), pfilter(NULL) {}
+    CRescanPrefetchJob(CRescanBlock* prescanBlockIn, const CWalletRescanFilter* pfilterIn) : prescanBlock(prescanBlockIn), pfilter(pfilterIn) {}
+
+    bool operator()()
+    {
+        CRescanBlock& rescanBlock = *prescanBlock;
+        rescanBlock.fRead = ReadBlockFromDisk(rescanBlock.block, rescanBlock.pindex);
+        if (!rescanBlock.fRead)
+            return true;
+        rescanBlock.vCandidate.resize(rescanBlock.block.vtx.size());
+        for (size_t j = 0; j < rescanBlock.block.vtx.size(); j++)
+            rescanBlock.vCandidate[j] = pfilter->IsCandidate(rescanBlock.block.vtx[j]);
+        return true;
+    }
+
+    void swap(CRescanPrefetchJob& job)
+    {
+        std::swap(prescanBlock, job.prescanBlock);
+        std::swap(pfilter, job.pfilter);
+    }
+};
+
+/** Workers for the prefetch queue, interrupted and joined when leaving scope so they never outlive the queue */
+class CRescanPrefetchThreads
+{
+private:
+    boost::thread_group threadGroup;
+
+public:
+    CRescanPrefetchThreads(CCheckQueue<CRescanPrefetchJob>& queue, int nThreads)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CCheckQueue<CRescanPrefetchJob>::Thread, &queue));
+    }
+
+    ~CRescanPrefetchThreads()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
+/** Collect the next batch of blocks following the active chain from pindexFrom */
+void CollectRescanBatch(CBlockIndex* pindexFrom, size_t nBatchSize, std::vector<CRescanBlock>& vBatch)
+{
+    vBatch.clear();
+    LOCK(cs_main);
+    for (CBlockIndex* pindex = pindexFrom; pindex && vBatch.size() < nBatchSize; pindex = chainActive.Next(pindex))
+        vBatch.push_back(CRescanBlock(pindex));
+}
+
+/** Queue every block of vBatch on the prefetch workers */
+void StartRescanPrefetch(CCheckQueueControl<CRescanPrefetchJob>& control, std::vector<CRescanBlock>& vBatch, const CWalletRescanFilter& filter)
+{
+    std::vector<CRescanPrefetchJob> vJobs;
+    vJobs.reserve(vBatch.size());
+    BOOST_FOREACH (CRescanBlock& rescanBlock, vBatch)
+        vJobs.push_back(CRescanPrefetchJob(&rescanBlock, &filter));
+    control.Add(vJobs);
+}
+} // anonymous namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against a prefilter of the wallet on
+ * -rescanthreads worker threads one batch ahead of the main thread, which
+ * applies them in chain order holding cs_main and cs_wallet only per block.
+ * Progress is saved periodically so an interrupted rescan resumes on the
+ * next startup.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1438,84 +1596,149 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     if (fCheckZZIJA)
         zpivTracker->Init();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+    const size_t nBatchSize = nThreads * RESCAN_BLOCKS_PER_THREAD;
+
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart, dProgressTip;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)) && pindex->nHeight <= Params().Zerocoin_StartHeight())
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
+    boost::scoped_ptr<CWalletRescanFilter> pfilter(new CWalletRescanFilter());
+    {
+        LOCK(cs_wallet);
 
-            //If this is a zapwallettx, need to readd zpiv
-            if (fCheckZZIJA && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
-                list<CZerocoinMint> listMints;
-                BlockToZerocoinMintList(block, listMints, true);
-
-                for (auto& m : listMints) {
-                    if (IsMyMint(m.GetValue())) {
-                        LogPrint("zero", "%s: found mint\n", __func__);
-                        pwalletMain->UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
-
-                        // Add the transaction to the wallet
-                        for (auto& tx : block.vtx) {
-                            uint256 txid = tx.GetHash();
-                            if (setAddedToWallet.count(txid) || mapWallet.count(txid))
-                                continue;
-                            if (txid == m.GetTxHash()) {
-                                CWalletTx wtx(pwalletMain, tx);
-                                wtx.nTimeReceived = block.GetBlockTime();
-                                wtx.SetMerkleBranch(block);
-                                pwalletMain->AddToWallet(wtx);
-                                setAddedToWallet.insert(txid);
-                            }
-                        }
+        std::set<CKeyID> setKeys;
+        GetKeys(setKeys);
+        BOOST_FOREACH (const CKeyID& keyID, setKeys) {
+            pfilter->insert(std::vector<unsigned char>(keyID.begin(), keyID.end()));
+            CPubKey pubkey;
+            if (GetPubKey(keyID, pubkey))
+                pfilter->insert(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+        }
+        for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it)
+            pfilter->insert(std::vector<unsigned char>(it->first.begin(), it->first.end()));
+        BOOST_FOREACH (const CScript& script, setWatchOnly)
+            pfilter->InsertScript(script);
+        BOOST_FOREACH (const CScript& script, setMultiSig)
+            pfilter->InsertScript(script);
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            pfilter->insert(it->first);
+            for (unsigned int i = 0; i < it->second.vout.size(); i++)
+                pfilter->insert(COutPoint(it->first, i));
+        }
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    // Transactions added by this rescan, their spends are not in the prefilter
+    set<uint256> setFound;
+    std::vector<CRescanBlock> vCurrent, vNext;
+    // One set of workers reads ahead for the whole rescan
+    CCheckQueue<CRescanPrefetchJob> prefetchQueue(1);
+    boost::scoped_ptr<CRescanPrefetchThreads> pprefetchThreads(new CRescanPrefetchThreads(prefetchQueue, nThreads));
+    CBlockIndex* pindexLast = NULL;
+
+    CollectRescanBatch(pindex, nBatchSize, vCurrent);
+    {
+        CCheckQueueControl<CRescanPrefetchJob> control(&prefetchQueue);
+        StartRescanPrefetch(control, vCurrent, *pfilter);
+        control.Wait();
+    }
 
-                        //Check if the mint was ever spent
-                        int nHeightSpend = 0;
-                        uint256 txidSpend;
-                        CTransaction txSpend;
-                        if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
-                            if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend))
-                                continue;
-
-                            CWalletTx wtx(pwalletMain, txSpend);
-                            CBlockIndex* pindexSpend = chainActive[nHeightSpend];
-                            CBlock blockSpend;
-                            if (ReadBlockFromDisk(blockSpend, pindexSpend))
-                                wtx.SetMerkleBranch(blockSpend);
-
-                            wtx.nTimeReceived = pindexSpend->nTime;
-                            pwalletMain->AddToWallet(wtx);
-                            setAddedToWallet.emplace(txidSpend);
-                        }
+    bool fInterrupted = false;
+    while (!vCurrent.empty()) {
+        // Read the next batch while the current one is applied
+        CBlockIndex* pindexNext = NULL;
+        {
+            LOCK(cs_main);
+            pindexNext = chainActive.Next(vCurrent.back().pindex);
+        }
+        CollectRescanBatch(pindexNext, nBatchSize, vNext);
+        CCheckQueueControl<CRescanPrefetchJob> control(&prefetchQueue);
+        StartRescanPrefetch(control, vNext, *pfilter);
+
+        CBlockIndex* pindexReorg = NULL;
+        BOOST_FOREACH (CRescanBlock& rescanBlock, vCurrent) {
+            if (ShutdownRequested()) {
+                fInterrupted = true;
+                break;
+            }
+            pindex = rescanBlock.pindex;
+            CBlock& block = rescanBlock.block;
+
+            LOCK2(cs_main, cs_wallet);
+            if (!chainActive.Contains(pindex)) {
+                // The chain was reorganised behind us, continue from the fork point
+                const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+                pindexReorg = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+                break;
+            }
+            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+            if (rescanBlock.fRead) {
+                for (size_t i = 0; i < block.vtx.size(); i++) {
+                    const CTransaction& tx = block.vtx[i];
+                    bool fCandidate = rescanBlock.vCandidate[i];
+                    for (unsigned int j = 0; !fCandidate && j < tx.vin.size(); j++)
+                        fCandidate = setFound.count(tx.vin[j].prevout.hash);
+                    if (!fCandidate)
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
+                        setFound.insert(tx.GetHash());
+                        ret++;
                     }
                 }
             }
 
-            pindex = chainActive.Next(pindex);
+            pindexLast = pindex;
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                CWalletDB(strWalletFile).WriteRescanPos(chainActive.GetLocator(pindex));
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        control.Wait();
+
+        if (fInterrupted)
+            break;
+        if (pindexReorg) {
+            CollectRescanBatch(pindexReorg, nBatchSize, vCurrent);
+            CCheckQueueControl<CRescanPrefetchJob> controlReorg(&prefetchQueue);
+            StartRescanPrefetch(controlReorg, vCurrent, *pfilter);
+            controlReorg.Wait();
+            continue;
+        }
+        vCurrent.swap(vNext);
+    }
+    pprefetchThreads.reset();
+
+    if (fInterrupted) {
+        LOCK(cs_main);
+        if (pindexLast && chainActive.Contains(pindexLast))
+            CWalletDB(strWalletFile).WriteRescanPos(chainActive.GetLocator(pindexLast));
+        LogPrintf("Rescan interrupted at block %d\n", pindexLast ? pindexLast->nHeight : 0);
+    } else {
+        CWalletDB(strWalletFile).EraseRescanPos();
     }
+
+    //If this is a zapwallettx, need to readd zpiv
+    if (fCheckZZIJA && !fInterrupted)
+        RestoreTrackedMintsFromChain();
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -5330,6 +5553,104 @@ bool CWallet::UpdateMint(const CBigNum& bnValue, const int& nHeight, const uint2
     return false;
 }
 
+/**
+ * Add a transaction of the active chain to the wallet if it is not there yet.
+ * Up to MAX_CHAIN_TX_BLOCK_CACHE blocks read for the merkle branch are kept
+ * in mapBlockCache so that callers restoring many transactions from nearby
+ * blocks rarely read one twice; when it is full the cached block furthest
+ * in height from the new one is dropped.
+ */
+bool CWallet::AddChainTxToWallet(const uint256& txid, CTransaction& tx, int& nHeight, std::map<uint256, CBlock>& mapBlockCache)
+{
+    LOCK2(cs_main, cs_wallet);
+    uint256 hashBlock;
+    if (!GetTransaction(txid, tx, hashBlock, true))
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return false;
+    CBlockIndex* pindex = mi->second;
+    nHeight = pindex->nHeight;
+
+    if (mapWallet.count(txid))
+        return true;
+
+    CWalletTx wtx(this, tx);
+    std::map<uint256, CBlock>::iterator it = mapBlockCache.find(hashBlock);
+    if (it == mapBlockCache.end()) {
+        CBlock block;
+        if (ReadBlockFromDisk(block, pindex)) {
+            if (mapBlockCache.size() >= MAX_CHAIN_TX_BLOCK_CACHE) {
+                // Evict the cached block furthest from this one
+                std::map<uint256, CBlock>::iterator itEvict = mapBlockCache.begin();
+                int nEvictDistance = -1;
+                for (std::map<uint256, CBlock>::iterator itCache = mapBlockCache.begin(); itCache != mapBlockCache.end(); ++itCache) {
+                    BlockMap::iterator miCache = mapBlockIndex.find(itCache->first);
+                    int nDistance = miCache == mapBlockIndex.end() ? std::numeric_limits<int>::max() : std::abs(miCache->second->nHeight - nHeight);
+                    if (nDistance > nEvictDistance) {
+                        itEvict = itCache;
+                        nEvictDistance = nDistance;
+                    }
+                }
+                mapBlockCache.erase(itEvict);
+            }
+            it = mapBlockCache.insert(std::make_pair(hashBlock, block)).first;
+        }
+    }
+    if (it != mapBlockCache.end())
+        wtx.SetMerkleBranch(it->second);
+
+    wtx.nTimeReceived = pindex->GetBlockTime();
+    AddToWallet(wtx);
+    return true;
+}
+
+/**
+ * Restore the chain state and transactions of every tracked zerocoin mint
+ * after -zapwallettxes with two batched zerocoinDB lookups, reading only the
+ * blocks that contain the wallet's mints and spends.
+ */
+void CWallet::RestoreTrackedMintsFromChain()
+{
+    std::set<CMintMeta> setMints = zpivTracker->ListMints(false, false, false);
+    std::vector<uint256> vHashPubcoin;
+    std::vector<uint256> vHashSerial;
+    for (const CMintMeta& meta : setMints) {
+        vHashPubcoin.push_back(meta.hashPubcoin);
+        vHashSerial.push_back(meta.hashSerial);
+    }
+
+    std::map<uint256, uint256> mapMintTx;
+    std::map<uint256, uint256> mapSpendTx;
+    zerocoinDB->ReadCoinMintBatch(vHashPubcoin, mapMintTx);
+    zerocoinDB->ReadCoinSpendBatch(vHashSerial, mapSpendTx);
+
+    std::map<uint256, CBlock> mapBlockCache;
+    for (CMintMeta meta : setMints) {
+        std::map<uint256, uint256>::const_iterator it = mapMintTx.find(meta.hashPubcoin);
+        if (it == mapMintTx.end())
+            continue;
+
+        CTransaction tx;
+        int nHeight = 0;
+        if (!AddChainTxToWallet(it->second, tx, nHeight, mapBlockCache))
+            continue;
+        LogPrint("zero", "%s: found mint\n", __func__);
+        meta.nHeight = nHeight;
+        meta.txid = it->second;
+        zpivTracker->UpdateState(meta);
+
+        //Check if the mint was ever spent
+        it = mapSpendTx.find(meta.hashSerial);
+        if (it != mapSpendTx.end()) {
+            CTransaction txSpend;
+            int nHeightSpend = 0;
+            AddChainTxToWallet(it->second, txSpend, nHeightSpend, mapBlockCache);
+        }
+    }
+    LogPrintf("%s: restored %u of %u tracked mints\n", __func__, mapMintTx.size(), setMints.size());
+}
+
 //! Primarily for the scenario that a mint was confirmed and added to the chain and then that block orphaned
 bool CWallet::SetMintUnspent(const CBigNum& bnSerial)
 {
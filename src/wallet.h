@@ -60,6 +60,14 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -rescanthreads default (0 = one per core)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of block prefetch threads used by a wallet rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Number of blocks each prefetch thread reads ahead per rescan batch
+static const int RESCAN_BLOCKS_PER_THREAD = 16;
+//! Number of blocks AddChainTxToWallet keeps read while restoring transactions
+static const unsigned int MAX_CHAIN_TX_BLOCK_CACHE = 16;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -223,6 +231,8 @@ public:
     bool DatabaseMint(CDeterministicMint& dMint);
     bool SetMintUnspent(const CBigNum& bnSerial);
     bool UpdateMint(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom);
+    bool AddChainTxToWallet(const uint256& txid, CTransaction& tx, int& nHeight, std::map<uint256, CBlock>& mapBlockCache);
+    void RestoreTrackedMintsFromChain();
     string GetUniqueWalletBackupName(bool fzpivAuto) const;
 
 
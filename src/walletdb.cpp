@@ -156,6 +156,23 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+bool CWalletDB::WriteRescanPos(const CBlockLocator& locator)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanpos"), locator);
+}
+
+bool CWalletDB::ReadRescanPos(CBlockLocator& locator)
+{
+    return Read(std::string("rescanpos"), locator);
+}
+
+bool CWalletDB::EraseRescanPos()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanpos"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
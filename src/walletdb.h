@@ -114,6 +114,10 @@ public:
     bool WriteBestBlock(const CBlockLocator& locator);
     bool ReadBestBlock(CBlockLocator& locator);
 
+    bool WriteRescanPos(const CBlockLocator& locator);
+    bool ReadRescanPos(CBlockLocator& locator);
+    bool EraseRescanPos();
+
     bool WriteOrderPosNext(int64_t nOrderPosNext);
 
     // presstab
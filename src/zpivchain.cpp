@@ -10,6 +10,8 @@
 #include "txdb.h"
 #include "ui_interface.h"
 
+#include <boost/thread/mutex.hpp>
+
 // 6 comes from OPCODE (1) + vch.size() (1) + BIGNUM size (4)
 #define SCRIPT_OFFSET 6
 // For Script size (BIGNUM/Uint256 size)
@@ -369,6 +371,75 @@ bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CV
     return true;
 }
 
+/**
+ * Zerocoin objects parsed from one transaction. Entries are immutable once
+ * set; the vectors themselves are guarded by cs.
+ */
+class CTxZerocoinCache
+{
+public:
+    boost::mutex cs;
+    //! accumulator parameters the spends were parsed with
+    const bool fV1Params;
+    std::vector<std::shared_ptr<const libzerocoin::CoinSpend> > vSpend;
+    std::vector<std::shared_ptr<const libzerocoin::PublicCoin> > vMint;
+
+    CTxZerocoinCache(const CTransaction& tx, bool fV1ParamsIn) : fV1Params(fV1ParamsIn), vSpend(tx.vin.size()), vMint(tx.vout.size()) {}
+};
+
+static std::shared_ptr<CTxZerocoinCache> GetTxZerocoinCache(const CTransaction& tx, bool fV1Params)
+{
+    std::shared_ptr<CTxZerocoinCache> cache = tx.GetZerocoinCache();
+    if (!cache)
+        cache = tx.InitZerocoinCache(std::make_shared<CTxZerocoinCache>(tx, fV1Params));
+    return cache;
+}
+
+std::shared_ptr<const libzerocoin::CoinSpend> TxInToZerocoinSpend(const CTransaction& tx, unsigned int nIn)
+{
+    bool fV1Params = chainActive.Height() < Params().Zerocoin_Block_V2_Start();
+    std::shared_ptr<CTxZerocoinCache> cache = GetTxZerocoinCache(tx, fV1Params);
+    if (cache->fV1Params != fV1Params || nIn >= cache->vSpend.size()) {
+        // only around the V2 switch: do not mix parameters, parse afresh
+        return std::make_shared<const libzerocoin::CoinSpend>(TxInToZerocoinSpend(tx.vin[nIn]));
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(cache->cs);
+        if (cache->vSpend[nIn])
+            return cache->vSpend[nIn];
+    }
+    // Parse without holding the lock; a concurrent parse of the same input
+    // produces an identical object and the first one stored wins.
+    std::shared_ptr<const libzerocoin::CoinSpend> spend = std::make_shared<const libzerocoin::CoinSpend>(TxInToZerocoinSpend(tx.vin[nIn]));
+    boost::unique_lock<boost::mutex> lock(cache->cs);
+    if (!cache->vSpend[nIn])
+        cache->vSpend[nIn] = spend;
+    return cache->vSpend[nIn];
+}
+
+bool TxOutToPublicCoin(const CTransaction& tx, unsigned int nOut, libzerocoin::PublicCoin& pubCoin, CValidationState& state)
+{
+    // mints are always parsed with the V2 parameters, whatever the height
+    std::shared_ptr<CTxZerocoinCache> cache = GetTxZerocoinCache(tx, chainActive.Height() < Params().Zerocoin_Block_V2_Start());
+    if (nOut >= cache->vMint.size())
+        return TxOutToPublicCoin(tx.vout[nOut], pubCoin, state);
+
+    {
+        boost::unique_lock<boost::mutex> lock(cache->cs);
+        if (cache->vMint[nOut]) {
+            pubCoin = *cache->vMint[nOut];
+            return true;
+        }
+    }
+    if (!TxOutToPublicCoin(tx.vout[nOut], pubCoin, state))
+        return false;
+    boost::unique_lock<boost::mutex> lock(cache->cs);
+    if (!cache->vMint[nOut])
+        cache->vMint[nOut] = std::make_shared<const libzerocoin::PublicCoin>(pubCoin);
+    return true;
+}
+
 //return a list of zerocoin spends contained in a specific block, list may have many denominations
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid)
 {
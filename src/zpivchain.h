@@ -11,6 +11,7 @@
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/CoinSpend.h"
 #include <list>
+#include <memory>
 #include <string>
 
 class CBlock;
@@ -38,6 +39,10 @@ bool RemoveSerialFromDB(const CBigNum& bnSerial);
 std::string ReindexZerocoinDB();
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
+/** CoinSpend of input nIn of tx, parsed once and shared by every copy of the transaction */
+std::shared_ptr<const libzerocoin::CoinSpend> TxInToZerocoinSpend(const CTransaction& tx, unsigned int nIn);
+/** PublicCoin of output nOut of tx, parsed once and shared by every copy of the transaction */
+bool TxOutToPublicCoin(const CTransaction& tx, unsigned int nOut, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid);
 
 
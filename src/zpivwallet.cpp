@@ -187,102 +187,117 @@ void CzZIJAWallet::SyncWithChain(bool fGenerateMintPool)
     bool found = true;
     CWalletDB walletdb(strWalletFile);
 
-    set<uint256> setAddedTx;
+    std::map<uint256, CBlock> mapBlockCache;
     while (found) {
         found = false;
         if (fGenerateMintPool)
             GenerateMintPool();
         LogPrintf("%s: Mintpool size=%d\n", __func__, mintPool.size());
 
-        std::set<uint256> setChecked;
+        // Look up the whole mint pool in the zerocoinDB at once
+        std::vector<uint256> vHashPubcoin;
         list<pair<uint256,uint32_t> > listMints = mintPool.List();
         for (pair<uint256, uint32_t> pMint : listMints) {
-            LOCK(cs_main);
-            if (setChecked.count(pMint.first))
-                return;
-            setChecked.insert(pMint.first);
+            if (pwalletMain->zpivTracker->HasPubcoinHash(pMint.first)) {
+                mintPool.Remove(pMint.first);
+                continue;
+            }
+            vHashPubcoin.push_back(pMint.first);
+        }
+        std::map<uint256, uint256> mapMintTx;
+        zerocoinDB->ReadCoinMintBatch(vHashPubcoin, mapMintTx);
 
+        std::vector<CDeterministicMint> vSeenMints;
+        for (pair<uint256, uint32_t> pMint : listMints) {
             if (ShutdownRequested())
                 return;
 
-            if (pwalletMain->zpivTracker->HasPubcoinHash(pMint.first)) {
-                mintPool.Remove(pMint.first);
+            std::map<uint256, uint256>::const_iterator it = mapMintTx.find(pMint.first);
+            if (it == mapMintTx.end())
+                continue;
+
+            //this mint has already occurred on the chain, increment counter's state to reflect this
+            const uint256& txHash = it->second;
+            LogPrintf("%s : Found wallet coin mint=%s count=%d tx=%s\n", __func__, pMint.first.GetHex(), pMint.second, txHash.GetHex());
+            found = true;
+
+            CTransaction tx;
+            int nHeight = 0;
+            if (!pwalletMain->AddChainTxToWallet(txHash, tx, nHeight, mapBlockCache)) {
+                LogPrintf("%s : failed to get transaction for mint %s!\n", __func__, pMint.first.GetHex());
+                found = false;
+                nLastCountUsed = std::max(pMint.second, nLastCountUsed);
                 continue;
             }
 
-            uint256 txHash;
-            CZerocoinMint mint;
-            if (zerocoinDB->ReadCoinMint(pMint.first, txHash)) {
-                //this mint has already occurred on the chain, increment counter's state to reflect this
-                LogPrintf("%s : Found wallet coin mint=%s count=%d tx=%s\n", __func__, pMint.first.GetHex(), pMint.second, txHash.GetHex());
-                found = true;
-
-                uint256 hashBlock;
-                CTransaction tx;
-                if (!GetTransaction(txHash, tx, hashBlock, true)) {
-                    LogPrintf("%s : failed to get transaction for mint %s!\n", __func__, pMint.first.GetHex());
-                    found = false;
-                    nLastCountUsed = std::max(pMint.second, nLastCountUsed);
+            //Find the denomination
+            CoinDenomination denomination = CoinDenomination::ZQ_ERROR;
+            bool fFoundMint = false;
+            CBigNum bnValue = 0;
+            for (const CTxOut& out : tx.vout) {
+                if (!out.scriptPubKey.IsZerocoinMint())
                     continue;
-                }
 
-                //Find the denomination
-                CoinDenomination denomination = CoinDenomination::ZQ_ERROR;
-                bool fFoundMint = false;
-                CBigNum bnValue = 0;
-                for (const CTxOut& out : tx.vout) {
-                    if (!out.scriptPubKey.IsZerocoinMint())
-                        continue;
-
-                    PublicCoin pubcoin(Params().Zerocoin_Params(false));
-                    CValidationState state;
-                    if (!TxOutToPublicCoin(out, pubcoin, state)) {
-                        LogPrintf("%s : failed to get mint from txout for %s!\n", __func__, pMint.first.GetHex());
-                        continue;
-                    }
-
-                    // See if this is the mint that we are looking for
-                    uint256 hashPubcoin = GetPubCoinHash(pubcoin.getValue());
-                    if (pMint.first == hashPubcoin) {
-                        denomination = pubcoin.getDenomination();
-                        bnValue = pubcoin.getValue();
-                        fFoundMint = true;
-                        break;
-                    }
+                PublicCoin pubcoin(Params().Zerocoin_Params(false));
+                CValidationState state;
+                if (!TxOutToPublicCoin(out, pubcoin, state)) {
+                    LogPrintf("%s : failed to get mint from txout for %s!\n", __func__, pMint.first.GetHex());
+                    continue;
                 }
 
-                if (!fFoundMint || denomination == ZQ_ERROR) {
-                    LogPrintf("%s : failed to get mint %s from tx %s!\n", __func__, pMint.first.GetHex(), tx.GetHash().GetHex());
-                    found = false;
+                // See if this is the mint that we are looking for
+                uint256 hashPubcoin = GetPubCoinHash(pubcoin.getValue());
+                if (pMint.first == hashPubcoin) {
+                    denomination = pubcoin.getDenomination();
+                    bnValue = pubcoin.getValue();
+                    fFoundMint = true;
                     break;
                 }
+            }
 
-                CBlockIndex* pindex = nullptr;
-                if (mapBlockIndex.count(hashBlock))
-                    pindex = mapBlockIndex.at(hashBlock);
+            if (!fFoundMint || denomination == ZQ_ERROR) {
+                LogPrintf("%s : failed to get mint %s from tx %s!\n", __func__, pMint.first.GetHex(), tx.GetHash().GetHex());
+                found = false;
+                break;
+            }
 
-                if (!setAddedTx.count(txHash)) {
-                    CBlock block;
-                    CWalletTx wtx(pwalletMain, tx);
-                    if (pindex && ReadBlockFromDisk(block, pindex))
-                        wtx.SetMerkleBranch(block);
+            CDeterministicMint dMint;
+            if (GenerateSeenMint(bnValue, nHeight, txHash, denomination, dMint))
+                vSeenMints.push_back(dMint);
+            nLastCountUsed = std::max(pMint.second, nLastCountUsed);
+        }
 
-                    //Fill out wtx so that a transaction record can be created
-                    wtx.nTimeReceived = pindex->GetBlockTime();
-                    pwalletMain->AddToWallet(wtx);
-                    setAddedTx.insert(txHash);
-                }
+        // Check all mints found in this round for spends at once
+        std::vector<uint256> vHashSerial;
+        for (const CDeterministicMint& dMint : vSeenMints)
+            vHashSerial.push_back(dMint.GetSerialHash());
+        std::map<uint256, uint256> mapSpendTx;
+        zerocoinDB->ReadCoinSpendBatch(vHashSerial, mapSpendTx);
 
-                SetMintSeen(bnValue, pindex->nHeight, txHash, denomination);
-                nLastCountUsed = std::max(pMint.second, nLastCountUsed);
-                nCountLastUsed = std::max(nLastCountUsed, nCountLastUsed);
-                LogPrint("zero", "%s: updated count to %d\n", __func__, nCountLastUsed);
-            }
+        for (CDeterministicMint& dMint : vSeenMints) {
+            std::map<uint256, uint256>::const_iterator it = mapSpendTx.find(dMint.GetSerialHash());
+            AddSeenMint(dMint, it != mapSpendTx.end() ? &it->second : nullptr, mapBlockCache);
         }
+        nCountLastUsed = std::max(nLastCountUsed, nCountLastUsed);
+        LogPrint("zero", "%s: updated count to %d\n", __func__, nCountLastUsed);
     }
 }
 
 bool CzZIJAWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const CoinDenomination& denom)
+{
+    CDeterministicMint dMint;
+    if (!GenerateSeenMint(bnValue, nHeight, txid, denom, dMint))
+        return false;
+
+    // Check if this is also already spent
+    uint256 txidSpend;
+    bool fSpent = zerocoinDB->ReadCoinSpend(dMint.GetSerialHash(), txidSpend);
+    std::map<uint256, CBlock> mapBlockCache;
+    AddSeenMint(dMint, fSpent ? &txidSpend : nullptr, mapBlockCache);
+    return true;
+}
+
+bool CzZIJAWallet::GenerateSeenMint(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const CoinDenomination& denom, CDeterministicMint& dMint)
 {
     if (!mintPool.Has(bnValue))
         return error("%s: value not in pool", __func__);
@@ -300,48 +315,41 @@ bool CzZIJAWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
     if (bnValueGen != bnValue)
         return error("%s: generated pubcoin and expected value do not match!", __func__);
 
-    // Create mint object and database it
+    // Create mint object
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     uint256 hashSerial = GetSerialHash(bnSerial);
     uint256 hashPubcoin = GetPubCoinHash(bnValue);
     uint256 nSerial = bnSerial.getuint256();
     uint256 hashStake = Hash(nSerial.begin(), nSerial.end());
-    CDeterministicMint dMint(PrivateCoin::CURRENT_VERSION, pMint.second, hashSeed, hashSerial, hashPubcoin, hashStake);
+    dMint = CDeterministicMint(PrivateCoin::CURRENT_VERSION, pMint.second, hashSeed, hashSerial, hashPubcoin, hashStake);
     dMint.SetDenomination(denom);
     dMint.SetHeight(nHeight);
     dMint.SetTxHash(txid);
+    return true;
+}
 
-    // Check if this is also already spent
-    int nHeightTx;
-    uint256 txidSpend;
-    CTransaction txSpend;
-    if (IsSerialInBlockchain(hashSerial, nHeightTx, txidSpend, txSpend)) {
-        //Find transaction details and make a wallettx and add to wallet
-        dMint.SetUsed(true);
-        CWalletTx wtx(pwalletMain, txSpend);
-        CBlockIndex* pindex = chainActive[nHeightTx];
-        CBlock block;
-        if (ReadBlockFromDisk(block, pindex))
-            wtx.SetMerkleBranch(block);
-
-        wtx.nTimeReceived = pindex->nTime;
-        pwalletMain->AddToWallet(wtx);
+void CzZIJAWallet::AddSeenMint(CDeterministicMint& dMint, const uint256* ptxidSpend, std::map<uint256, CBlock>& mapBlockCache)
+{
+    // Add the spending transaction to the wallet if the mint was spent in the active chain
+    if (ptxidSpend) {
+        CTransaction txSpend;
+        int nHeightSpend;
+        if (pwalletMain->AddChainTxToWallet(*ptxidSpend, txSpend, nHeightSpend, mapBlockCache))
+            dMint.SetUsed(true);
     }
 
     // Add to zpivTracker which also adds to database
     pwalletMain->zpivTracker->Add(dMint, true);
-    
+
     //Update the count if it is less than the mint's count
-    if (nCountLastUsed < pMint.second) {
+    if (nCountLastUsed < dMint.GetCount()) {
         CWalletDB walletdb(strWalletFile);
-        nCountLastUsed = pMint.second;
+        nCountLastUsed = dMint.GetCount();
         walletdb.WriteZZIJACount(nCountLastUsed);
     }
 
     //remove from the pool
     mintPool.Remove(dMint.GetPubcoinHash());
-
-    return true;
 }
 
 // Check if the value of the commitment meets requirements
@@ -13,6 +13,7 @@
 #include "uint256.h"
 #include "primitives/zerocoin.h"
 
+class CBlock;
 class CDeterministicMint;
 
 class CzZIJAWallet
@@ -45,6 +46,8 @@ public:
 
 private:
     uint512 GetZerocoinSeed(uint32_t n);
+    bool GenerateSeenMint(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom, CDeterministicMint& dMint);
+    void AddSeenMint(CDeterministicMint& dMint, const uint256* ptxidSpend, std::map<uint256, CBlock>& mapBlockCache);
 };
 
 #endif //ZIJA_ZZIJAWALLET_H